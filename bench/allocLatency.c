@@ -0,0 +1,117 @@
+/*
+ * Worst-case myAlloc and myFree latency of every engine on a heap holding
+ * 1M blocks, half of them freed in random order so the free blocks are
+ * spread over the whole heap in all sizes.  The TLSF engine must keep
+ * its worst case flat, the others are listed for comparison.
+ * The heap and the sample arrays are touched before the timed loop, so a
+ * worst case is the allocator's and not the first touch of a page.  The
+ * page faults and preemptions that still hit the timed loop are printed
+ * with each engine's numbers.
+ */
+#include <string.h>
+#include <sys/resource.h>
+#include "myHeap.h"
+#include "bench.h"
+
+#define BLOCKS (1000 * 1000)
+#define SAMPLES (200 * 1000)
+#define CHUNK (1 << 20)
+
+static void *blocks[BLOCKS];
+static long allocTimes[SAMPLES];
+static long freeTimes[SAMPLES];
+
+static int compareLong(const void *a, const void *b) {
+    long x = *(const long*)a, y = *(const long*)b;
+    return x < y ? -1 : x > y;
+}
+
+// prints the median, the 99.9th and 99.99th percentiles and the worst of
+// 'count' times, the worst includes whatever the scheduler did meanwhile
+static void report(const char *name, const char *call, long *times, int count) {
+    qsort(times, count, sizeof(long), compareLong);
+    printf("%-6s %-7s median %5ld ns  p99.9 %7ld ns  p99.99 %7ld ns  worst %8ld ns\n",
+           name, call, times[count / 2], times[count - count / 1000],
+           times[count - count / 10000], times[count - 1]);
+}
+
+// allocates the whole heap in chunks, writes to them and frees them again,
+// so every page of the heap is mapped before anything is timed
+static void prefault(myHeap *h) {
+    static void *chunks[4096];
+    int count = 0;
+    while (count < 4096 && (chunks[count] = myHeapAlloc(h, CHUNK)) != NULL) {
+        memset(chunks[count++], 0, CHUNK);
+    }
+    while (count > 0) {
+        myHeapFree(h, chunks[--count]);
+    }
+    myHeapCoalesce(h);
+}
+
+static int run(const char *name, int engine, int coalesceMode) {
+    unsigned int seed = 1;
+    myOpt(MYHEAP_OPT_ENGINE, engine);
+    myOpt(MYHEAP_OPT_COALESCE, coalesceMode);
+    myHeap *h = myHeapCreate(512 << 20);
+    if (h == NULL) {
+        fprintf(stderr, "allocLatency: myHeapCreate failed\n");
+        return 1;
+    }
+    prefault(h);
+    memset(blocks, 0, sizeof(blocks));
+    memset(allocTimes, 0, sizeof(allocTimes));
+    memset(freeTimes, 0, sizeof(freeTimes));
+
+    for (int i = 0; i < BLOCKS; i++) {
+        blocks[i] = myHeapAlloc(h, 8 + nextRandom(&seed) % 249);
+        if (blocks[i] == NULL) {
+            fprintf(stderr, "allocLatency: heap too small for %d blocks\n", BLOCKS);
+            return 1;
+        }
+    }
+    for (int i = BLOCKS - 1; i > 0; i--) {
+        int j = nextRandom(&seed) % (i + 1);
+        void *swap = blocks[i];
+        blocks[i] = blocks[j];
+        blocks[j] = swap;
+    }
+    for (int i = 0; i < BLOCKS / 2; i++) {
+        myHeapFree(h, blocks[i]);
+        blocks[i] = NULL;
+    }
+
+    // every sample frees a random live block and allocates one in its place
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    for (int i = 0; i < SAMPLES; i++) {
+        int slot = BLOCKS / 2 + nextRandom(&seed) % (BLOCKS / 2);
+        long start = nowNs();
+        myHeapFree(h, blocks[slot]);
+        long middle = nowNs();
+        blocks[slot] = myHeapAlloc(h, 8 + nextRandom(&seed) % 1017);
+        long end = nowNs();
+        if (blocks[slot] == NULL) {
+            fprintf(stderr, "allocLatency: myHeapAlloc failed\n");
+            return 1;
+        }
+        freeTimes[i] = middle - start;
+        allocTimes[i] = end - middle;
+    }
+    getrusage(RUSAGE_SELF, &after);
+
+    report(name, "myAlloc", allocTimes, SAMPLES);
+    report(name, "myFree", freeTimes, SAMPLES);
+    printf("%-6s page faults %ld  preemptions %ld while timing\n", name,
+           after.ru_minflt + after.ru_majflt - before.ru_minflt - before.ru_majflt,
+           after.ru_nivcsw - before.ru_nivcsw);
+    myHeapDestroy(h);
+    return 0;
+}
+
+int main() {
+    int failed = run("bins", MYHEAP_ENGINE_BINS, MYHEAP_COALESCE_IMMEDIATE);
+    failed |= run("tree", MYHEAP_ENGINE_TREE, MYHEAP_COALESCE_IMMEDIATE);
+    failed |= run("tlsf", MYHEAP_ENGINE_TLSF, MYHEAP_COALESCE_IMMEDIATE);
+    return failed;
+}
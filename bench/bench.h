@@ -0,0 +1,43 @@
+/*
+ * Helpers shared by the benchmarks.  The options of the default heap are
+ * fixed by the one myInit call a process makes, so every configuration
+ * that needs one runs in a child process of its own.
+ */
+#ifndef __bench_h
+#define __bench_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static inline long nowNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+// small random numbers without a lock, one state per thread
+static inline unsigned int nextRandom(unsigned int *state) {
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+// runs 'bench' with 'arg' in a child process, returns its exit status
+static inline int runChild(int (*bench)(long), long arg) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int result = bench(arg);
+        fflush(stdout);
+        _exit(result);
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+        return 1;
+    }
+    return WEXITSTATUS(status);
+}
+
+#endif
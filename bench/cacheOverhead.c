@@ -0,0 +1,83 @@
+/*
+ * Memory held by the caches of 1000 threads, with per-thread caches and
+ * with per-CPU caches of the same count.  Every thread allocates and
+ * frees blocks of all cached sizes, then waits until all the others have
+ * done the same.  Blocks sitting in a cache count as used by the heap, so
+ * the used size at that point is what the caches hold.
+ */
+#include <pthread.h>
+#include "myHeap.h"
+#include "bench.h"
+
+#define THREADS 1000
+#define COUNT 32
+#define SIZES 63        // 8 to 504 bytes, the sizes the caches hold
+
+static pthread_barrier_t filled, measured;
+static int failed;
+
+static void* fill(void *unused) {
+    (void)unused;
+    void *blocks[COUNT];
+    for (int size = 1; size <= SIZES; size++) {
+        for (int i = 0; i < COUNT; i++) {
+            blocks[i] = myAlloc(size * 8);
+            if (blocks[i] == NULL) {
+                __atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+            }
+        }
+        for (int i = 0; i < COUNT; i++) {
+            myFree(blocks[i]);
+        }
+    }
+    pthread_barrier_wait(&filled);
+    pthread_barrier_wait(&measured);
+    return NULL;
+}
+
+// 'perCpu' picks MYHEAP_OPT_CPUCACHE over MYHEAP_OPT_TCACHE
+static int run(long perCpu) {
+    myOpt(perCpu ? MYHEAP_OPT_CPUCACHE : MYHEAP_OPT_TCACHE, COUNT);
+    if (myInit(1 << 30) != 0) {
+        fprintf(stderr, "cacheOverhead: myInit failed\n");
+        return 1;
+    }
+    if (perCpu && myStat(MYHEAP_STAT_CPUCACHE) == 0) {
+        printf("per-CPU    caches unavailable, rseq or membarrier missing\n");
+        return 0;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 64 << 10);
+    pthread_barrier_init(&filled, NULL, THREADS + 1);
+    pthread_barrier_init(&measured, NULL, THREADS + 1);
+    static pthread_t workers[THREADS];
+    for (int i = 0; i < THREADS; i++) {
+        if (pthread_create(&workers[i], &attr, fill, NULL) != 0) {
+            fprintf(stderr, "cacheOverhead: could not start thread %d\n", i);
+            return 1;
+        }
+    }
+    pthread_barrier_wait(&filled);
+    long used = myStat(MYHEAP_STAT_USED_SIZE);
+    pthread_barrier_wait(&measured);
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    if (failed) {
+        fprintf(stderr, "cacheOverhead: heap too small for the caches\n");
+        return 1;
+    }
+
+    printf("%-10s caches, %d threads on %ld CPUs: %8ld KB cached, %6ld bytes per thread\n",
+           perCpu ? "per-CPU" : "per-thread", THREADS, sysconf(_SC_NPROCESSORS_ONLN),
+           used >> 10, used / THREADS);
+    return 0;
+}
+
+int main() {
+    int failed = runChild(run, 0);
+    failed |= runChild(run, 1);
+    return failed;
+}
@@ -0,0 +1,81 @@
+/*
+ * Throughput of one heap shared by 1 to 32 threads, with the plain mutex
+ * and with MYHEAP_OPT_COMBINING.  Every thread keeps 64 small blocks
+ * alive and writes to them, and replaces one of them with each myFree
+ * and myAlloc.  The threads allocate from the same free blocks, so the
+ * neighbours of a thread's blocks mostly belong to other threads, and an
+ * allocator that writes the headers of neighbouring blocks would keep
+ * taking their cache lines away from them.  Combining can only beat the
+ * mutex when the threads run on several cores at once, on a single core
+ * both print about the same.
+ *
+ * The p-bits are kept out of line for good, so to see what writing the
+ * next block's header cost, "make baseline" builds this against the
+ * myHeap.c from before that change as well and runs both.  That one has
+ * no combining, only the mutex rows are printed for it.
+ * Usage: contention [max threads]
+ */
+#include <pthread.h>
+#include <string.h>
+#include "myHeap.h"
+#include "bench.h"
+
+#define LIVE 64
+#define ROUNDS (500 * 1000)
+
+static myHeap *shared;
+
+static void* work(void *arg) {
+    unsigned int seed = (unsigned int)(long)arg + 1;
+    void *live[LIVE];
+    for (int i = 0; i < LIVE; i++) {
+        live[i] = myHeapAlloc(shared, 16);
+    }
+    for (long round = 0; round < ROUNDS; round++) {
+        int slot = nextRandom(&seed) % LIVE;
+        memset(live[slot], (int)round, 8);
+        myHeapFree(shared, live[slot]);
+        live[slot] = myHeapAlloc(shared, 8 + nextRandom(&seed) % 57);
+    }
+    for (int i = 0; i < LIVE; i++) {
+        myHeapFree(shared, live[i]);
+    }
+    return NULL;
+}
+
+static int run(const char *name, int threads) {
+    shared = myHeapCreate(64 << 20);
+    if (shared == NULL) {
+        fprintf(stderr, "contention: myHeapCreate failed\n");
+        return 1;
+    }
+    pthread_t workers[64];
+    long start = nowNs();
+    for (long i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, work, (void*)i);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    double seconds = (nowNs() - start) / 1e9;
+    myHeapDestroy(shared);
+
+    printf("%-9s threads %2d  %7.2f Mops/s\n", name, threads,
+           2.0 * ROUNDS * threads / seconds / 1e6);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int max = argc > 1 ? atoi(argv[1]) : 32;
+    int failed = 0;
+    printf("cores online: %ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+    for (int threads = 1; threads <= max && threads <= 64; threads *= 2) {
+        failed |= run("mutex", threads);
+#ifdef MYHEAP_OPT_COMBINING
+        myOpt(MYHEAP_OPT_COMBINING, 1);
+        failed |= run("combining", threads);
+        myOpt(MYHEAP_OPT_COMBINING, 0);
+#endif
+    }
+    return failed;
+}
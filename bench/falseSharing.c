@@ -0,0 +1,101 @@
+/*
+ * Concurrent counter updates in small blocks, with MYHEAP_OPT_ISOLATE off
+ * and on.  The threads allocate their counters in turns, so without the
+ * option the counters of different threads end up next to each other and
+ * every increment fights over a cache line another thread writes too.
+ * Besides the update rate, the number of counters sharing a cache line
+ * with another thread's counter is printed.
+ * Usage: falseSharing [threads]
+ */
+#include <sched.h>
+#include <pthread.h>
+#include "myHeap.h"
+#include "bench.h"
+
+#define COUNTERS 64
+#define ROUNDS (2 * 1000 * 1000)
+#define MAX_THREADS 64
+
+static int threads;
+static int turn;
+static long *counters[MAX_THREADS][COUNTERS];
+static long began[MAX_THREADS];
+static pthread_barrier_t start;
+
+static void* update(void *arg) {
+    long self = (long)arg;
+    for (int i = 0; i < COUNTERS; i++) {
+        while (__atomic_load_n(&turn, __ATOMIC_ACQUIRE) != i * threads + self) {
+            sched_yield();
+        }
+        counters[self][i] = myAlloc(sizeof(long));
+        *counters[self][i] = 0;
+        __atomic_store_n(&turn, i * threads + self + 1, __ATOMIC_RELEASE);
+    }
+    pthread_barrier_wait(&start);
+    began[self] = nowNs();
+    for (long round = 0; round < ROUNDS; round++) {
+        volatile long *counter = counters[self][round % COUNTERS];
+        *counter += 1;
+    }
+    return NULL;
+}
+
+// counters whose cache line also holds a counter of another thread
+static long shared() {
+    long count = 0;
+    for (int t = 0; t < threads; t++) {
+        for (int i = 0; i < COUNTERS; i++) {
+            unsigned long line = (unsigned long)counters[t][i] / 64;
+            int found = 0;
+            for (int u = 0; u < threads && !found; u++) {
+                for (int j = 0; j < COUNTERS && !found; j++) {
+                    found = u != t && (unsigned long)counters[u][j] / 64 == line;
+                }
+            }
+            count += found;
+        }
+    }
+    return count;
+}
+
+static int run(long isolate) {
+    myOpt(MYHEAP_OPT_ISOLATE, isolate);
+    if (myInit(16 << 20) != 0) {
+        fprintf(stderr, "falseSharing: myInit failed\n");
+        return 1;
+    }
+    pthread_barrier_init(&start, NULL, threads + 1);
+    pthread_t workers[MAX_THREADS];
+    for (long i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, update, (void*)i);
+    }
+    pthread_barrier_wait(&start);
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    // from the first thread that started updating, the threads may run
+    // before this one is back from the barrier
+    long begin = began[0];
+    for (int i = 1; i < threads; i++) {
+        begin = began[i] < begin ? began[i] : begin;
+    }
+    double seconds = (nowNs() - begin) / 1e9;
+
+    printf("isolate %s  threads %2d  %7.1f M updates/s  %4ld of %d counters share a line\n",
+           isolate ? "on " : "off", threads, (double)ROUNDS * threads / seconds / 1e6,
+           shared(), threads * COUNTERS);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    threads = argc > 1 ? atoi(argv[1]) : 4;
+    if (threads < 2 || threads > MAX_THREADS) {
+        fprintf(stderr, "falseSharing: between 2 and %d threads\n", MAX_THREADS);
+        return 1;
+    }
+    printf("cores online %ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+    int failed = runChild(run, 0);
+    failed |= runChild(run, 1);
+    return failed;
+}
@@ -0,0 +1,88 @@
+/*
+ * Peak resident memory of 8 threads with arenas (MYHEAP_OPT_ARENAS) when
+ * they produce in turns: one thread at a time allocates and writes 16 MB
+ * of blocks and frees them again while the others wait.  Without stealing
+ * every arena must hold the whole 16 MB, and each one that served a turn
+ * keeps its pages.  With MYHEAP_OPT_STEAL the arenas are sized for an
+ * even share and a producer allocates from its peers' idle memory once
+ * its own arena is full, so the pages touched first are reused.
+ */
+#include <string.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "myHeap.h"
+#include "bench.h"
+
+#define THREADS 8
+#define PEAK (16 << 20)
+#define BLOCK 4000
+
+static pthread_barrier_t turn;
+static int failed;
+
+static void* produce(void *arg) {
+    long self = (long)arg;
+    static __thread void *blocks[PEAK / BLOCK];
+    // arenas are attached on first use, every one must exist before the
+    // first turn for there to be peers to steal from
+    myFree(myAlloc(8));
+    pthread_barrier_wait(&turn);
+    for (int round = 0; round < THREADS; round++) {
+        if (round == self) {
+            for (int i = 0; i < PEAK / BLOCK; i++) {
+                blocks[i] = myAlloc(BLOCK);
+                if (blocks[i] == NULL) {
+                    __atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+                    break;
+                }
+                memset(blocks[i], 1, BLOCK);
+            }
+            for (int i = 0; i < PEAK / BLOCK && blocks[i] != NULL; i++) {
+                myFree(blocks[i]);
+            }
+        }
+        pthread_barrier_wait(&turn);
+        // stolen blocks were handed back to their arenas, merge them there
+        coalesce();
+        pthread_barrier_wait(&turn);
+    }
+    return NULL;
+}
+
+// 'steal' turns on MYHEAP_OPT_STEAL and shrinks the arenas to a share
+static int run(long steal) {
+    long arenaSize = steal ? PEAK / THREADS * 5 / 4 : PEAK * 9 / 8;
+    myOpt(MYHEAP_OPT_ARENAS, 1);
+    myOpt(MYHEAP_OPT_STEAL, steal);
+    if (myInit(arenaSize) != 0) {
+        fprintf(stderr, "skewedProducers: myInit failed\n");
+        return 1;
+    }
+
+    pthread_barrier_init(&turn, NULL, THREADS);
+    pthread_t workers[THREADS];
+    long start = nowNs();
+    for (long i = 0; i < THREADS; i++) {
+        pthread_create(&workers[i], NULL, produce, (void*)i);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    double seconds = (nowNs() - start) / 1e9;
+    if (failed) {
+        fprintf(stderr, "skewedProducers: a producer ran out of memory\n");
+        return 1;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("%-8s arenas of %5ld KB  peak RSS %7ld KB  %5.2f s\n",
+           steal ? "stealing" : "own only", arenaSize >> 10, usage.ru_maxrss, seconds);
+    return 0;
+}
+
+int main() {
+    int failed = runChild(run, 0);
+    failed |= runChild(run, 1);
+    return failed;
+}
@@ -0,0 +1,81 @@
+/*
+ * Stress run of the lock-free stacks for 1 to 64 threads, against the
+ * heap's lock alone.  Every thread replaces random blocks of 8 to 256
+ * bytes it keeps alive, and swaps some of them through a shared table
+ * with blocks of other threads, so blocks are pushed and popped by many
+ * threads at once and often freed by another thread than the one that
+ * allocated them.  Afterwards every block must be back in the heap.
+ * Usage: stackStress [max threads]
+ */
+#include <pthread.h>
+#include "myHeap.h"
+#include "bench.h"
+
+#define LIVE 256
+#define EXCHANGE 1024
+#define ROUNDS (500 * 1000)
+
+static void *exchange[EXCHANGE];
+
+static void* work(void *arg) {
+    unsigned int seed = (unsigned int)(long)arg + 1;
+    void *live[LIVE];
+    for (int i = 0; i < LIVE; i++) {
+        live[i] = myAlloc(8 + nextRandom(&seed) % 249);
+    }
+    for (long round = 0; round < ROUNDS; round++) {
+        int slot = nextRandom(&seed) % LIVE;
+        if (round % 4 == 0) {
+            live[slot] = __atomic_exchange_n(&exchange[nextRandom(&seed) % EXCHANGE],
+                                             live[slot], __ATOMIC_ACQ_REL);
+        }
+        myFree(live[slot]);
+        live[slot] = myAlloc(8 + nextRandom(&seed) % 249);
+    }
+    for (int i = 0; i < LIVE; i++) {
+        myFree(live[i]);
+    }
+    return NULL;
+}
+
+// 'config' holds the thread count, times 2 with the stacks on
+static int run(long config) {
+    int threads = config / 2;
+    int stacks = config % 2;
+    if (stacks) {
+        myOpt(MYHEAP_OPT_LOCKFREE, 256);
+    }
+    if (myInit(64 << 20) != 0) {
+        fprintf(stderr, "stackStress: myInit failed\n");
+        return 1;
+    }
+
+    pthread_t workers[64];
+    long start = nowNs();
+    for (long i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, work, (void*)i);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    double seconds = (nowNs() - start) / 1e9;
+
+    for (int i = 0; i < EXCHANGE; i++) {
+        myFree(exchange[i]);
+    }
+    coalesce();
+    long used = myStat(MYHEAP_STAT_USED_SIZE);
+    printf("%-8s threads %2d  %7.2f Mops/s  %s\n", stacks ? "lockfree" : "mutex", threads,
+           2.0 * ROUNDS * threads / seconds / 1e6, used == 0 ? "ok" : "blocks lost");
+    return used != 0;
+}
+
+int main(int argc, char **argv) {
+    int max = argc > 1 ? atoi(argv[1]) : 64;
+    int failed = 0;
+    for (int threads = 1; threads <= max && threads <= 64; threads *= 2) {
+        failed |= runChild(run, threads * 2);
+        failed |= runChild(run, threads * 2 + 1);
+    }
+    return failed;
+}
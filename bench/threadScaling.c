@@ -0,0 +1,114 @@
+/*
+ * Throughput of the default heap for 2 to 32 threads, with only the
+ * heap's lock and with the per-thread caches, for two workloads.  In the
+ * local one every thread keeps 64 blocks alive and replaces one of them
+ * with each myFree and myAlloc.  In the producer/consumer one half of the
+ * threads allocate blocks and pass them through a ring to a consumer
+ * thread of their own, which frees them, so every block is freed by
+ * another thread than the one that allocated it.
+ * Usage: threadScaling [max threads]
+ */
+#include <pthread.h>
+#include <sched.h>
+#include "myHeap.h"
+#include "bench.h"
+
+#define BLOCKS_PER_PRODUCER (1000 * 1000)
+#define RING 1024
+#define LIVE 64
+
+typedef struct pair {
+    void *ring[RING];
+    long head __attribute__((aligned(64)));   // written by the producer
+    long tail __attribute__((aligned(64)));   // written by the consumer
+} pair;
+
+static pair rings[32];
+
+static void* produce(void *arg) {
+    pair *p = arg;
+    unsigned int seed = (unsigned int)(p - rings) + 1;
+    for (long i = 0; i < BLOCKS_PER_PRODUCER; i++) {
+        void *ptr = myAlloc(8 + nextRandom(&seed) % 249);
+        while (i - __atomic_load_n(&p->tail, __ATOMIC_ACQUIRE) >= RING) {
+            sched_yield();
+        }
+        p->ring[i % RING] = ptr;
+        __atomic_store_n(&p->head, i + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static void* consume(void *arg) {
+    pair *p = arg;
+    for (long i = 0; i < BLOCKS_PER_PRODUCER; i++) {
+        while (__atomic_load_n(&p->head, __ATOMIC_ACQUIRE) <= i) {
+            sched_yield();
+        }
+        myFree(p->ring[i % RING]);
+        __atomic_store_n(&p->tail, i + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static void* local(void *arg) {
+    unsigned int seed = (unsigned int)(long)arg;
+    void *live[LIVE] = { NULL };
+    for (long i = 0; i < BLOCKS_PER_PRODUCER; i++) {
+        int slot = nextRandom(&seed) % LIVE;
+        myFree(live[slot]);
+        live[slot] = myAlloc(8 + nextRandom(&seed) % 249);
+    }
+    for (int i = 0; i < LIVE; i++) {
+        myFree(live[i]);
+    }
+    return NULL;
+}
+
+// 'config' holds the thread count times 4, plus 2 for producer/consumer
+// pairs and 1 for the per-thread caches
+static int run(long config) {
+    int threads = config / 4;
+    int pairs = config / 2 % 2;
+    int cached = config % 2;
+    if (cached) {
+        myOpt(MYHEAP_OPT_TCACHE, 64);
+    }
+    if (myInit(256 << 20) != 0) {
+        fprintf(stderr, "threadScaling: myInit failed\n");
+        return 1;
+    }
+
+    pthread_t workers[64];
+    long start = nowNs();
+    for (int i = 0; i < threads / 2; i++) {
+        if (pairs) {
+            pthread_create(&workers[2 * i], NULL, produce, &rings[i]);
+            pthread_create(&workers[2 * i + 1], NULL, consume, &rings[i]);
+        } else {
+            pthread_create(&workers[2 * i], NULL, local, (void*)(long)(2 * i + 1));
+            pthread_create(&workers[2 * i + 1], NULL, local, (void*)(long)(2 * i + 2));
+        }
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    double seconds = (nowNs() - start) / 1e9;
+
+    // a myAlloc and a myFree per block, local threads do as many as a pair
+    printf("%-6s %-5s threads %2d  %7.2f Mops/s\n", cached ? "tcache" : "mutex",
+           pairs ? "pairs" : "local", threads,
+           2.0 * BLOCKS_PER_PRODUCER * (pairs ? threads / 2 : threads) / seconds / 1e6);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int max = argc > 1 ? atoi(argv[1]) : 32;
+    int failed = 0;
+    for (int threads = 2; threads <= max && threads <= 64; threads *= 2) {
+        for (int config = 0; config < 4; config++) {
+            failed |= runChild(run, threads * 4 + config);
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,98 @@
+/*
+ * dTLB load misses of a random walk over 1M blocks spread over a 512 MB
+ * default heap, with normal pages and with each kind of huge page.  The
+ * misses are counted with perf_event_open, where the kernel refuses that
+ * only the time is printed.
+ */
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "myHeap.h"
+#include "bench.h"
+
+#define BLOCKS (1000 * 1000)
+#define STEPS (20 * 1000 * 1000)
+
+static void *blocks[BLOCKS];
+
+static const char *backing[] = { "normal", "thp", "hugetlb" };
+
+// a counter of the calling thread's dTLB load misses, -1 if there is none
+static int openCounter() {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static int run(long huge) {
+    unsigned int seed = 1;
+    myOpt(MYHEAP_OPT_HUGEPAGES, huge);
+    if (myInit(512 << 20) != 0) {
+        fprintf(stderr, "tlbMisses: myInit failed\n");
+        return 1;
+    }
+    // blocks of 8 to 512 bytes, so 1M of them cover most of the heap
+    for (int i = 0; i < BLOCKS; i++) {
+        blocks[i] = myAlloc(8 + nextRandom(&seed) % 505);
+        if (blocks[i] == NULL) {
+            fprintf(stderr, "tlbMisses: heap too small for %d blocks\n", BLOCKS);
+            return 1;
+        }
+    }
+    // every block points at the next one of a random cycle through all of them
+    for (int i = BLOCKS - 1; i > 0; i--) {
+        int j = nextRandom(&seed) % (i + 1);
+        void *swap = blocks[i];
+        blocks[i] = blocks[j];
+        blocks[j] = swap;
+    }
+    for (int i = 0; i < BLOCKS; i++) {
+        *(void**)blocks[i] = blocks[(i + 1) % BLOCKS];
+    }
+
+    int counter = openCounter();
+    void *walk = blocks[0];
+    long start = nowNs();
+    if (counter >= 0) {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    for (long i = 0; i < STEPS; i++) {
+        walk = *(void* volatile*)walk;
+    }
+    long misses = -1;
+    if (counter >= 0) {
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counter, &misses, sizeof(misses)) != sizeof(misses)) {
+            misses = -1;
+        }
+        close(counter);
+    }
+    double ns = (double)(nowNs() - start) / STEPS;
+
+    // the backing asked for may have fallen back to a smaller one
+    long used = myStat(MYHEAP_STAT_HUGEPAGES);
+    printf("%-7s (got %-7s %5ld KB pages)  %6.1f ns/load  ", backing[huge],
+           backing[used], myStat(MYHEAP_STAT_PAGE_SIZE) >> 10, ns);
+    if (misses < 0) {
+        printf("dTLB misses unavailable\n");
+    } else {
+        printf("dTLB misses %5.3f/load\n", (double)misses / STEPS);
+    }
+    return walk == NULL;
+}
+
+int main() {
+    int failed = runChild(run, MYHEAP_HUGE_OFF);
+    failed |= runChild(run, MYHEAP_HUGE_THP);
+    failed |= runChild(run, MYHEAP_HUGE_HUGETLB);
+    return failed;
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -5,15 +6,42 @@
 #include <sys/mman.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
 #include "myHeap.h"
+
+// kernels and libcs without MADV_FREE purge with MADV_DONTNEED instead
+#ifndef MADV_FREE
+#define MADV_FREE MADV_DONTNEED
+#endif
  
+/*
+ * Type of block sizes, block offsets and the size_status word.  It is an
+ * int by default, which keeps headers and footers at 4 bytes and caps the
+ * heap below 2 GiB.  Building with -DMYHEAP_64BIT makes it a long, for
+ * 8-byte headers and heaps and blocks beyond 2 GiB.  HSIZE_MAX is its
+ * largest value and HSIZE_BITS its number of value bits.  It is one type
+ * for all heaps since every header, footer, link and offset is read
+ * through it; a width chosen per heap would cost a branch on each read.
+ */
+#ifdef MYHEAP_64BIT
+typedef long hsize;
+#define HSIZE_MAX 0x7fffffffffffffffL
+#else
+typedef int hsize;
+#define HSIZE_MAX 0x7fffffff
+#endif
+#define HSIZE_BITS (8 * (int)sizeof(hsize) - 1)
+
 /*
  * This structure serves as the header for each allocated and free block.
  * It also serves as the footer for each free block but only containing size.
  */
 typedef struct blockHeader {           
 
-    int size_status;
+    hsize size_status;
     /*
      * Size of the block is always a multiple of 8.
      * Size is stored in all block headers and in free block footers.
@@ -23,459 +51,4649 @@ typedef struct blockHeader {
      *   Bit0 == 0 => free block
      *   Bit0 == 1 => allocated block
      *
-     *   Bit1 => second last bit 
-     *   Bit1 == 0 => previous block is free
-     *   Bit1 == 1 => previous block is allocated
+     *   Bit1 => second last bit, always 0
+     *   Whether the previous block is allocated (the p-bit) is kept out
+     *   of line in prevMap, see prevAllocated
+     *
+     *   Bit2 => third last bit, always 0
+     *   Whether the block has an entry in the dirty queue is kept out
+     *   of line in queuedMap, see isQueued
      * 
      * End Mark: 
      *  The end of the available memory is indicated using a size_status of 1.
+     *
+     * The examples below use the default 4-byte header, with MYHEAP_64BIT
+     * every header and footer takes 8 bytes instead.
      * 
      * Examples:
      * 
      * 1. Allocated block of size 24 bytes:
      *    Allocated Block Header:
-     *      If the previous block is free      p-bit=0 size_status would be 25
-     *      If the previous block is allocated p-bit=1 size_status would be 27
+     *      size_status would be 25
      * 
      * 2. Free block of size 24 bytes:
      *    Free Block Header:
-     *      If the previous block is free      p-bit=0 size_status would be 24
-     *      If the previous block is allocated p-bit=1 size_status would be 26
+     *      size_status would be 24
      *    Free Block Footer:
      *      size_status should be 24
+     *
+     * Free blocks also carry the next/prev links of their free list at the
+     * start of their payload, see freeLinks below.
      */
 } blockHeader;         
 
-/* Global variable - DO NOT CHANGE. It should always point to the first block,
- * i.e., the block at the lowest address.
+/*
+ * Free blocks are kept in size-class bins so that myAlloc never has to look
+ * at allocated blocks.  Each free block stores the links of its bin list in
+ * the first 8 bytes of its payload, between the header and the footer:
+ *
+ *   | header | next | prev | ... | footer |
+ *
+ * Links are byte offsets from heapStart (NO_BLOCK ends a list), which keeps
+ * the smallest free block at 16 bytes (32 with MYHEAP_64BIT).  Every block
+ * is at least MIN_BLOCK bytes so that it can hold its links once it is freed.
+ *
+ * The bins hold exactly one block size each (16, 24, ..., SMALL_LIMIT-8),
+ * so a block is pushed and popped at the head of its bin and any block in
+ * the first non-empty bin that fits is a best fit.  binmap has a bit set
+ * for every non-empty bin.  Free blocks of SMALL_LIMIT bytes or more are
+ * kept in the AVL tree of MYHEAP_ENGINE_TREE instead, see below, so that
+ * neither myFree nor myAlloc ever walks a list of blocks of many sizes.
  */
-blockHeader *heapStart = NULL;     
+#define MIN_BLOCK (2 * (int)sizeof(blockHeader) + (int)sizeof(freeLinks))
+#define TREE_MIN_BLOCK ((2 * (int)sizeof(blockHeader) + (int)sizeof(treeNode) + 7) / 8 * 8)
+#define SMALL_LIMIT 512
+#define NUM_BINS (SMALL_LIMIT / 8 - 2)
+#define NO_BLOCK -1
+
+typedef struct freeLinks {
+    hsize next;
+    hsize prev;
+} freeLinks;
 
-/* Size of heap allocation padded to round to nearest page size.
+/*
+ * With MYHEAP_ENGINE_TREE all free blocks are instead kept in an AVL tree
+ * ordered by (size, address), with the node stored where the bin links
+ * would be.  The node needs 16 bytes (32 with MYHEAP_64BIT), so in that
+ * mode blocks are at least TREE_MIN_BLOCK bytes.  'run' is scratch space
+ * used by coalesce().  The bins engine uses the same tree for its blocks
+ * of SMALL_LIMIT bytes or more, which always have room for the node.
+ * There the node can cover where the header of a block it absorbed was,
+ * so 'height' is kept doubled: an even word there reads as a free header
+ * and myFree still turns away the absorbed block.
  */
-int allocsize;
+typedef struct treeNode {
+    hsize left;
+    hsize right;
+    hsize run;
+    int height;     // twice the height of the subtree
+} treeNode;
 
 /*
- * Additional global variables may be added as needed below
+ * With MYHEAP_ENGINE_TLSF (two-level segregated fit) the free blocks are
+ * kept in tlsfLists[fl][sl], linked through freeLinks like the bins.  The
+ * first level splits sizes by powers of two, the second level splits each
+ * power of two into TLSF_SL_COUNT equal ranges; sizes below TLSF_SMALL all
+ * share first level 0 in steps of 8.  tlsfFlMap has a bit per non-empty
+ * first level and tlsfSlMap[fl] a bit per non-empty list, so a fitting list
+ * is found with two find-first-set instructions.  Free blocks are merged
+ * with their neighbours right away, which keeps myAlloc and myFree at a
+ * constant number of steps.
  */
+#define TLSF_SL_LOG2 4
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG2)
+#define TLSF_FL_SHIFT (TLSF_SL_LOG2 + 3)
+#define TLSF_SMALL (1 << TLSF_FL_SHIFT)
+#define TLSF_FL_COUNT (HSIZE_BITS - TLSF_FL_SHIFT + 1)
 
- 
-/* 
- * Function for allocating 'size' bytes of heap memory.
- * Argument size: requested size for the payload
- * Returns address of allocated block (payload) on success.
- * Returns NULL on failure.
- *
- * This function must:
- * - Check size - Return NULL if not positive or if larger than heap space.
- * - Determine block size rounding up to a multiple of 8 
- *   and possibly adding padding as a result.
- *
- * - Use BEST-FIT PLACEMENT POLICY to chose a free block
- *
- * - If the BEST-FIT block that is found is exact size match
- *   - 1. Update all heap blocks as needed for any affected blocks
- *   - 2. Return the address of the allocated block payload
- *
- * - If the BEST-FIT block that is found is large enough to split 
- *   - 1. SPLIT the free block into two valid heap blocks:
- *         1. an allocated block
- *         2. a free block
- *         NOTE: both blocks must meet heap block requirements 
- *       - Update all heap block header(s) and footer(s) 
- *              as needed for any affected blocks.
- *   - 2. Return the address of the allocated block payload
- *
- * - If a BEST-FIT block found is NOT found, return NULL
- *   Return NULL unable to find and allocate block for desired size
- *
- * Note: payload address that is returned is NOT the address of the
- *       block header.  It is the address of the start of the 
- *       available memory for the requesterr.
+/*
+ * With MYHEAP_COALESCE_INCREMENTAL myFree records each freed block in the
+ * dirty queue, a ring of block offsets, and coalesce() only merges the
+ * queued blocks with their neighbours.  A queued block has its bit set in
+ * queuedMap, a bit per 8 bytes of the reservation like prevMap, and is
+ * never absorbed by another block, so every entry keeps pointing at a
+ * block header until it is processed.  A block that is allocated while
+ * queued keeps the bit so that freeing it again does not queue it twice.
+ * The bit is out of line because the queue is drained under the lock
+ * while the block may already be live again, and its header is read by
+ * the front ends without the lock.  Every pair of adjacent free blocks
+ * has at least one queued block, so draining the queue leaves nothing to
+ * merge.
+ */
+#define DIRTY_QUEUE_SIZE 256
+
+/*
+ * With MYHEAP_OPT_MAX_SIZE myInit reserves address space for the largest
+ * heap up front but only makes sizeOfRegion of it accessible.  When myAlloc
+ * finds no fit the heap grows in place: more of the reservation is made
+ * accessible, the old end mark becomes the header of a new free block and
+ * a new end mark is written after it.  Since the heap stays one contiguous
+ * range, block offsets and the heap walk are unaffected and no bridge
+ * blocks are needed between the old and the new part.  The heap at least
+ * doubles each time to keep the number of mprotect calls logarithmic.
  *
- * Tips: Be careful with pointer arithmetic and scale factors.
+ * The end mark has no p-bit, so lastAllocated tracks whether the block in
+ * front of it is allocated for the new free block.
  */
-void* myAlloc(int size) {     
 
-    	//TODO: Your code goes in here.
-    if(size <= 0 || size > allocsize){
-	    return NULL;
-    }
+/*
+ * With MYHEAP_OPT_HUGEPAGES the heap is backed by 2 MiB pages, either from
+ * the hugetlb pool (MAP_HUGETLB) or as a 2 MiB aligned anonymous mapping
+ * marked MADV_HUGEPAGE for transparent huge pages.  myInit falls back from
+ * hugetlb to transparent huge pages to the normal /dev/zero mapping when a
+ * step is not available, hugeActive records what it got.  heapPage is the
+ * page size the heap is sized, grown and purged in, so purging never
+ * breaks up a huge page.  Blocks of LARGE_LIMIT bytes or more are split
+ * off the high end of a free block while huge pages are in use, which
+ * keeps the small blocks packed together in as few huge pages as possible.
+ */
+#define HUGE_PAGE (2 * 1024 * 1024)
+#define LARGE_LIMIT (64 * 1024)
 
-    //add 4 to size
-    size += 4;
+/*
+ * With MYHEAP_OPT_PURGE the pages that lie entirely inside a free block are
+ * given back to the OS with madvise once the block has been free for
+ * purgeDecay milliseconds, so that memory freed and reused right away is
+ * not purged and faulted in again over and over.  Free blocks of at least
+ * two pages keep the time they were last indexed right after the space
+ * the links or tree node use (see stampOf).  purgedMap has one bit per
+ * page of the reservation, set while the page is purged and not yet handed
+ * out again by myAlloc.  A free block at the end of the heap is also cut
+ * off and its pages made inaccessible again, growHeap can get them back.
+ */
 
-    //checks if multiple of 8
-    if(size % 8 != 0){
-	    size = size + 8 - (size % 8);
-    }
+/*
+ * The p-bit of every block, set when the block in front of it is
+ * allocated, lives in prevMap rather than in the block's header.  It has
+ * one bit per 8 bytes of the reservation, indexed by block offset, and is
+ * only meaningful at offsets where a block starts.  Allocating or freeing
+ * a block changes the p-bit of the block after it, which with the bit in
+ * the header meant writing to the cache line of what may be another
+ * thread's live object.  Now myAlloc and myFree only write their own
+ * block, free neighbours they merge with and the map.  It also leaves the
+ * header of a live block to be written only by whoever allocates and
+ * frees it.
+ */
 
-    //blockHeader types for the current pointer and a pointer for the best spot in memory
-    blockHeader *best = NULL;
-    blockHeader *current = heapStart;
+/*
+ * With MYHEAP_OPT_ISOLATE the payloads of blocks allocated by different
+ * threads never share a cache line, so that objects of one thread do not
+ * slow down those of another through false sharing.  lines has an entry
+ * per ISOLATE_LINE bytes of the reservation, which belongs to the thread
+ * that last allocated a block whose payload touches it, for as long as
+ * 'users' such blocks are allocated.  myAlloc only places a block where
+ * the first and the last line of its payload are unused or belong to the
+ * calling thread, the lines in between lie inside the free block it is
+ * cut from.  The best fitting block is tried first, at its start or with
+ * the payload moved to the next line, the part in front staying a free
+ * block.  Only if that does not work is a block 2 * (ISOLATE_LINE +
+ * minBlock) bytes larger looked for, which always has room for lines of
+ * its own.  Blocks
+ * of one thread still share lines, so only the ends of runs of blocks of
+ * one thread cost space.
+ *
+ * Blocks must not move to another thread without going through the heap,
+ * so the per-thread cache only keeps blocks of the thread that frees
+ * them, and the front ends that pass blocks between threads (per-CPU
+ * caches, magazines and lock-free stacks) are not used by myInit.
+ */
+#define ISOLATE_LINE 64
 
-    // signifies that you found a place for the best fit block
-    int flag = 0;
+typedef struct lineOwner {
+    unsigned int owner;     // thread id
+    unsigned int users;     // allocated blocks of the owner touching the line
+} lineOwner;
 
-    //size of the current and best pointer
-    int current_size = 0; 
-    int best_size = 0;
+// thread heapAlloc places blocks for, 0 for the calling thread
+static __thread unsigned int allocFor;
 
-    //loops through the current pointer to memory as long as it does not reach the end bit
-    while(current -> size_status != 1){
-	
+// set while heapAlloc must not grow the heap, see arenaSteal
+static __thread int allocNoGrow;
 
-        //updates size_status	    
-	current_size = current -> size_status - current -> size_status % 8;
-	// checks if the a-bit is free meaning this particular 
-	// block of code is free. % 2 takes into consideration the last bit
-	// odd is 1, even 0
-	if(current -> size_status % 2 != 0 || current_size < size){
-		//casts to void* which is a generic pointer, scale factor is 1
-		current = (void*)current + current_size;
-		//current_size = current -> size_status - current -> size_status % 8;
-		continue;
+/*
+ * With MYHEAP_OPT_COMBINING myAlloc and myFree do not queue up on the
+ * heap's lock.  A thread publishes its call in its slot of the heap, and
+ * whichever thread gets the lock runs the published calls of all slots in
+ * one pass before it lets go (flat combining, Hendler et al.).  The heap's
+ * metadata then stays in the cache of one core for a whole batch instead
+ * of moving to the core of every caller in turn.  A thread waiting for its
+ * call keeps trying the lock, so the calls never wait for a combiner that
+ * does not come.  Slots are picked by thread id, a thread whose slot is
+ * busy takes the lock as before.  Every slot has a cache line of its own
+ * so that publishing a call only writes the caller's line.
+ *
+ * A call that finds the lock free runs right away without publishing
+ * anything, so a thread that has the heap to itself pays for one trylock.
+ * The holder of the lock only looks at the slots while 'pending' counts
+ * published calls that have not run yet.
+ */
+#define COMBINE_SLOTS 64
+#define COMBINE_SPINS 100
+#define COMBINE_NONE 0
+#define COMBINE_ALLOC 1
+#define COMBINE_FREE 2
 
-	}
+typedef struct combineSlot {
+    int busy;            // claimed by a thread for the length of its call
+    int op;              // COMBINE_*, back to COMBINE_NONE once the call ran
+    myHeapSize size;
+    void *ptr;           // block to free, or the block allocated
+    int result;          // heapFree's result, or MYHEAP_RETRY_* of the alloc
+    unsigned int thread; // id of the calling thread
+} __attribute__((aligned(64))) combineSlot;
 
-	//happens the first time to set things in place, initialize flag and set pointers
-	if(flag==0){
-		flag = 1;
-		best = current;
-		best_size = current_size;
-		
-	}
+/*
+ * Options of a heap, set with myOpt() for the heaps created after the call.
+ */
+typedef struct heapOptions {
+    int engine;          // MYHEAP_ENGINE_*
+    int coalesceMode;    // MYHEAP_COALESCE_*, TLSF always merges on free
+    int coalesceBudget;  // most queued blocks one coalesce() processes, 0 for all
+    int retryOnFail;     // whether myAlloc merges and retries before failing
+    hsize maxSize;       // MYHEAP_OPT_MAX_SIZE
+    int hugeMode;        // MYHEAP_HUGE_* asked for
+    int purgeMode;       // MYHEAP_PURGE_*
+    int purgeDecay;      // milliseconds a page stays free before it is purged
+    int tcacheCount;     // MYHEAP_OPT_TCACHE
+    int arenas;          // MYHEAP_OPT_ARENAS
+    int cpuCacheCount;   // MYHEAP_OPT_CPUCACHE
+    int magazineSize;    // MYHEAP_OPT_MAGAZINES
+    int combining;       // MYHEAP_OPT_COMBINING
+    int stackCount;      // MYHEAP_OPT_LOCKFREE
+    int shards;          // MYHEAP_OPT_SHARDS
+    int steal;           // MYHEAP_OPT_STEAL
+    int reclaimInterval; // MYHEAP_OPT_RECLAIM, milliseconds
+    int walkThreads;     // MYHEAP_OPT_WALK_THREADS
+    int isolate;         // MYHEAP_OPT_ISOLATE
+} heapOptions;
 
-	//finds the smallest appropriate block of memory in heap for us to use
-	if(current_size < best_size){
-		best_size = current_size;
-		best = current;
-	}
+/*
+ * Everything one heap needs, see the sections above for how each part is
+ * used.  The global API works on defaultHeap, the myHeap* functions on a
+ * heap made by myHeapCreate.  Every public function takes the heap's lock
+ * and points 'heap' at it, and all the helpers below use that heap.
+ * 'heap' is thread-local so that threads can work on different heaps.
+ */
+struct myHeap {
+    heapOptions opt;
 
-	//jumps to next block unconditionally, not enough memory in this one
-	current = (void*) current + current_size;
-    }
+    // held by every public function while it works on the heap
+    pthread_mutex_t lock;
 
-    //if the flag is 0, meaning we have found no eligible blocks, we return NULL 
-    if(flag == 0) return NULL;
+    // the first block, i.e., the block at the lowest address
+    blockHeader *heapStart;
+    // size of the heap padded to whole pages, less 8 for alignment and end mark
+    hsize allocsize;
 
-    //the case for when the size is perfect for the data
-    if(best_size == size){
-	// set a block to 1
-	best -> size_status += 1;
+    // smallest block size the engine can index
+    int minBlock;
 
-	//jumps to next block space
-	blockHeader *new = (void*) best +  best_size;
-	
-	//as long as its not on the end bit 
-	if(new -> size_status != 1){
-		// set p block to 1
-		new -> size_status += 2;
-	}
+    hsize bins[NUM_BINS];
+    unsigned int binmap[(NUM_BINS + 31) / 32];
 
-	//returns the best ptr if the memory block is the exact size and then adds on the extra space for the header
-	return (void*) best + sizeof(blockHeader); //why do we not just return best? wouldn't this take us to the beginning of the previous block?	
-    }
+    hsize treeRoot;
 
-    //if the size is too big and can be split up into an allocated block and a free block
-	    blockHeader *new = (blockHeader*) ((void*) best + size); 
+    hsize tlsfLists[TLSF_FL_COUNT][TLSF_SL_COUNT];
+    unsigned long long tlsfFlMap;
+    unsigned int tlsfSlMap[TLSF_FL_COUNT];
 
-	    //increments size_status to increment a bit, and to update the size in the footer 
-	    best -> size_status += size - best_size + 1;
-	    
-	    //size_status should be the p-bit + a-bit + size-of-block
-	    //so this one, is unallocated, the previous is allocated, would 
-	    //have a value of p + a + size = 2 + 0 + (best_size - size)
-	    new -> size_status = 2 + 0 + (best_size - size);
+    hsize dirtyQueue[DIRTY_QUEUE_SIZE];
+    int dirtyHead;
+    int dirtyCount;
 
-	    //footer pointer, moves over to start of footer
-	    blockHeader *new_footer = (void*) new + best_size - size - sizeof(blockHeader);
+    // how often myAlloc merged and retried, and how often that found a block
+    long retryCount;
+    long retryHits;
 
-	    //footer holds only size of the memory space
-	    new_footer -> size_status = best_size - size;
+    hsize reservesize;
+    int lastAllocated;
+    long growCount;
 
-	   
-	    //returns address of the payload
-	    return (void*) best + sizeof(blockHeader);
-} 
- 
-/* 
- * Function for freeing up a previously allocated block.
- * Argument ptr: address of the block to be freed up.
- * Returns 0 on success.
- * Returns -1 on failure.
- * This function should:
- * - Return -1 if ptr is NULL.
- * - Return -1 if ptr is not a multiple of 8.
- * - Return -1 if ptr is outside of the heap space.
- * - Return -1 if ptr block is already freed.
- * - Update header(s) and footer as needed.
- */                   
-int myFree(void *ptr) {    
-    //TODO: Your code goes in here.
-    //
-     //return -1 if ptr is NULL
-    if(ptr == NULL){
-            return -1;
-    }
+    int hugeActive;
+    int heapPage;
 
-    //return -1 if ptr is not a multiple of 8
-    if((int)ptr % 8 != 0){
-            return -1;
-    }
+    unsigned char *prevMap;
+    // dirty queue entries, NULL without MYHEAP_COALESCE_INCREMENTAL
+    unsigned char *queuedMap;
+    // block starts for parallel walks and the reclaimer, NULL without
+    // MYHEAP_OPT_WALK_THREADS and MYHEAP_OPT_RECLAIM
+    unsigned char *startMap;
 
-    
-    //return -1 if ptr is outside of the heap space
-    if(ptr < (void*)heapStart || ptr > (void*)heapStart + allocsize){
-	    return -1;
-    }
+    // cache line owners, NULL without MYHEAP_OPT_ISOLATE
+    lineOwner *lines;
+    // blocks moved to a line of their own
+    long isolateMoves;
 
-    //header variable
-    blockHeader *header = ptr - sizeof(blockHeader);
+    // purged by the reclaimer thread rather than by myFree
+    int reclaimed;
+    // where the reclaimer goes on merging with delayed coalescing
+    hsize reclaimCursor;
 
-    //checks if there is an A-Bit or not, if it is already freed, return -1
-    if(header -> size_status % 2 == 0){
-		return -1;
-    }
+    unsigned int lastPurge;
+    unsigned char *purgedMap;
+    long purgedPages;
+    long refaultedPages;
 
-    //takes out a bit 
-    header -> size_status -= 1;
+    // id of the thread owning the heap as an arena, 0 while it has none,
+    // and blocks other threads freed into it
+    unsigned int owner;
+    hsize remoteFrees;
+    // blocks the owner got from other arenas, see arenaSteal
+    long steals;
 
-    //this jumps to next block so we can change the p-bit
-    int block_size = header -> size_status - header -> size_status % 8;
+    combineSlot slots[COMBINE_SLOTS];
+    // calls published in the slots and not run yet
+    int pending __attribute__((aligned(64)));
+};
 
-    //new pointer that goes to the header of the next one
-    blockHeader *new = (void*)header + block_size;
+static heapOptions options = {
+    .engine = MYHEAP_ENGINE_BINS,
+    .coalesceMode = MYHEAP_COALESCE_DELAYED,
+    .purgeDecay = 10000,
+};
 
-    //as long as its not at the end bit 
-    if(new -> size_status != 1){
+static myHeap defaultHeap = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static __thread myHeap *heap = &defaultHeap;
 
-	    //checks p-bit status by &ing with 2 and decrements size status by it
-	    int p = new -> size_status & 2;
-	    new -> size_status -= p;
-    }
+/*
+ * With MYHEAP_OPT_TCACHE every thread keeps a cache of blocks it freed
+ * from the default heap, one list per block size below TCACHE_LIMIT, so
+ * that most small myAlloc and myFree calls never take the heap's lock.
+ * Cached blocks stay allocated as far as the heap is concerned.  A list
+ * that is empty is refilled and a list that is full is flushed, half of
+ * opt.tcacheCount blocks at a time under a single lock.  A thread hands
+ * its cached blocks back when it exits, and a thread whose myAlloc fails
+ * hands them back before trying again.
+ *
+ * Cached blocks are linked through tcacheEntry at the start of their
+ * payload, 'next' being an offset from heapStart like the free lists.
+ * 'key' holds the owning thread's id so that freeing a cached block again
+ * is caught without searching the list in the common case.
+ */
+#define TCACHE_LIMIT 512
+#define TCACHE_CLASSES (TCACHE_LIMIT / 8)
 
-    //this is the footer pointer
-    blockHeader *footer = (void*)header + block_size - sizeof(blockHeader); 
-    
-    // changes the size of the footer 
-    footer -> size_status = block_size;
+typedef struct tcacheEntry {
+    hsize next;
+    unsigned int key;
+} tcacheEntry;
 
-    //returns 0 because successful
-    return 0;
-} 
+/*
+ * The magazines, the lock-free stacks and the per-CPU caches mark the
+ * blocks they hold with cacheKey in the 'key' of their tcacheEntry, so
+ * that myFree catches a block freed again while it is cached without
+ * looking for it.  myInit picks a key with the top
+ * bit set, unlike the thread ids of the per-thread cache and the small
+ * numbers a program is likely to have left in a block.
+ */
+static unsigned int cacheKey;
 
 /*
- * Function for traversing heap block list and coalescing all adjacent 
- * free blocks.
+ * With MYHEAP_OPT_MAGAZINES the small blocks of the default heap are
+ * instead cached in magazines, arrays of block addresses of one block
+ * size (Bonwick and Adams, "Magazines and Vmem").  Each thread has a
+ * loaded and a previous magazine per block size and only uses the depot
+ * once both are empty, for myAlloc, or both are full, for myFree.  The
+ * depot of a block size keeps the full and the empty magazines of all
+ * threads, so a whole magazine of blocks moves from the thread that freed
+ * them to the thread that allocates them in one step under the depot's
+ * lock, instead of one block at a time under the heap's lock.
  *
- * This function is used for delayed coalescing.
- * Updated header size_status and footer size_status as needed.
+ * A depot counts how often its lock was contended, and when that happens
+ * in more than one out of MAGAZINE_CONTENTION uses it doubles the size of
+ * the magazines it hands out from then on, up to MAGAZINE_MAX, so busy
+ * block sizes go to the depot less often.  Magazines are allocated from
+ * the default heap itself.  coalesce() gives the blocks in the caller's
+ * magazines and in the full ones of the depots back to the heap, and the
+ * magazines with them, see depotReap.
  */
-int coalesce() {
-    //TODO: Your code goes in here.
+#define MAGAZINE_MAX 512
+#define MAGAZINE_CONTENTION 16
 
-	//creates a new pointer to the beginning of the heap
-	blockHeader *ptr = heapStart;
-	int ptr_size = 0;
+typedef struct magazine {
+    struct magazine *next;   // depot list
+    int rounds;              // blocks held in slots[0 .. rounds-1]
+    int capacity;
+    void *slots[];
+} magazine;
 
-	//while the end bit is not hit
-	while(ptr -> size_status != 1){
+typedef struct depot {
+    pthread_mutex_t lock;
+    magazine *full;
+    magazine *empty;
+    int magazineSize;        // capacity of new magazines
+    int uses;                // lock uses and contended ones since the last check
+    int contended;
+} depot;
 
-		//update size_status for the ptr
-		ptr_size = ptr -> size_status - ptr -> size_status % 8;
-		//if there is an a bit we increment the size accordingly and keep looping
-		if(ptr -> size_status & 1){
-			ptr = (void*) ptr + ptr_size;
-			continue;
-		}
+static depot depots[TCACHE_CLASSES] = {
+    [0 ... TCACHE_CLASSES - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER },
+};
 
-		//pointer to the next block
-		blockHeader *next = (void*) ptr + ptr_size;
+/*
+ * With MYHEAP_OPT_LOCKFREE requests of up to STACK_LIMIT bytes to the
+ * default heap are served from lock-free stacks of freed blocks, one per
+ * block size and shared by all threads (Treiber stacks).  Blocks are
+ * linked through the 'next' link at the start of their payload, as
+ * offsets from heapStart, and stay allocated as far as the heap is
+ * concerned.
+ *
+ * The head of a stack packs the top block's offset / 8 + 1, 0 for an
+ * empty stack, into the low STACK_TAG_SHIFT bits and a tag into the bits
+ * above.  The tag changes with every push and pop, so a pop that read the
+ * top block and its 'next' before another thread popped that block and
+ * pushed it back fails its compare-and-swap instead of installing a stale
+ * 'next' (the ABA problem).  The tag wraps after 2^24 changes, a pop would
+ * have to stall through exactly that many to be fooled.  A stalled pop
+ * may read the 'next' of a block that has since been handed out, which is
+ * harmless since the heap's memory stays mapped: purgeTail leaves the
+ * heap alone while the stacks are on.
+ *
+ * An empty stack is refilled with a batch of blocks taken from the heap
+ * under a single lock and pushed with one compare-and-swap.  A stack that
+ * holds opt.stackCount blocks sends further frees to the heap, and
+ * coalesce() empties all of them into the heap.
+ */
+#define STACK_LIMIT 256
+#define STACK_TAG_SHIFT 40
+#define STACK_BATCH 32
 
-		//checks the a bit and if allocated, ptr is set to the next block
-		if(next -> size_status & 1){
-			ptr = next;
-			continue;
-                }
+typedef struct lockfreeStack {
+    unsigned long long head;
+    long count;             // blocks on the stack, approximate
+} __attribute__((aligned(64))) lockfreeStack;
 
-		//sets the next size
-		int next_size = next -> size_status - next -> size_status % 8;
+static lockfreeStack stacks[TCACHE_CLASSES];
 
-		//sets pointer to the next blocks footer 
-		blockHeader *nextFooter = (void*) next + next_size - sizeof(blockHeader*);
+/*
+ * myRetire frees a block only once no thread can still be reading it
+ * (epoch-based reclamation, Fraser).  There is a global epoch, and every
+ * thread that calls myEnter gets an epochRecord in which it publishes the
+ * epoch it saw on entry until it calls myLeave.  The epoch moves on by
+ * one when every thread inside myEnter has seen the current one, so once
+ * it is two past the epoch a block was retired in, every thread that
+ * could have reached the block before it was unlinked has left.
+ *
+ * Retired blocks are kept per thread in three limbos, one per epoch
+ * modulo 3, in magazines of RETIRE_BATCH addresses allocated with myAlloc.
+ * When a magazine is full the thread tries to move the epoch on and gives
+ * every limbo that is old enough back to the heap, under one lock of the
+ * default heap for a whole magazine.  coalesce() does the same.  Records
+ * are never unmapped, a thread that exits leaves its record to the next
+ * new thread and its limbos to orphans, which whoever moves the epoch on
+ * collects.
+ */
+#define RETIRE_BATCH 64
 
-		//updates current pointers size_status for the footer because now the size post-coalesce is larger
-		ptr -> size_status += next_size;
-		nextFooter -> size_status += ptr_size;
-		ptr_size += next_size;
+typedef struct epochRecord {
+    unsigned long state;            // epoch * 2 + 1 inside myEnter, 0 outside
+    int owned;                      // whether a thread uses the record
+    struct epochRecord *next;       // all records ever made
+} __attribute__((aligned(64))) epochRecord;
 
-	}
+typedef struct limbo {
+    unsigned long epoch;            // epoch the blocks were retired in
+    magazine *batches;              // the latest one first
+} limbo;
 
-	return 1;
-}
+static unsigned long globalEpoch;
+static epochRecord *epochRecords;
+static limbo orphans[3];
+static pthread_mutex_t orphanLock = PTHREAD_MUTEX_INITIALIZER;
 
- 
-/* 
- * Function used to initialize the memory allocator.
- * Intended to be called ONLY once by a program.
- * Argument sizeOfRegion: the size of the heap space to be allocated.
- * Returns 0 on success.
- * Returns -1 on failure.
- */                    
-int myInit(int sizeOfRegion) {    
- 
-    static int allocated_once = 0; //prevent multiple myInit calls
- 
-    int pagesize;   // page size
-    int padsize;    // size of padding when heap size not a multiple of page size
-    void* mmap_ptr; // pointer to memory mapped area
-    int fd;
+typedef struct threadCache {
+    hsize lists[TCACHE_CLASSES];
+    int counts[TCACHE_CLASSES];
+    magazine *loaded[TCACHE_CLASSES];
+    magazine *previous[TCACHE_CLASSES];
+    epochRecord *record;
+    int epochDepth;    // myEnter calls not left yet
+    limbo retired[3];
+    unsigned int id;   // the thread's id, 0 until it needs one, see threadStart
+} threadCache;
 
-    blockHeader* endMark;
-  
-    if (0 != allocated_once) {
-        fprintf(stderr, 
-        "Error:mem.c: InitHeap has allocated space during a previous call\n");
-        return -1;
-    }
+static __thread threadCache tcache;
+static unsigned int threadIds;
+static pthread_key_t threadKey;
+static pthread_once_t threadOnce = PTHREAD_ONCE_INIT;
 
-    if (sizeOfRegion <= 0) {
-        fprintf(stderr, "Error:mem.c: Requested block size is not positive\n");
-        return -1;
-    }
+/*
+ * With MYHEAP_OPT_CPUCACHE the small blocks freed from the default heap
+ * are cached per CPU instead of per thread, so the memory held by caches
+ * grows with the number of CPUs rather than the number of threads.  Each
+ * CPU has a stack of block addresses per block size in cpuCaches[cpu].
+ * The stacks are only changed inside restartable sequences (rseq): the
+ * kernel sends a thread that is preempted, migrated or signalled before
+ * the final store of a sequence to its abort label, so the thread that
+ * completes a sequence had the CPU to itself and needs neither a lock nor
+ * an atomic instruction.  The sequences are x86-64 assembly using the
+ * rseq area libc registers for every thread.  Without it, on another
+ * architecture or when libc or the kernel do not provide rseq, myInit
+ * turns on the per-thread cache with the same count instead, as it does
+ * when membarrier cannot restart the sequences of another CPU.  coalesce()
+ * empties the stacks of every CPU from the calling thread, see cpuReap.
+ */
+#if defined(__x86_64__) && defined(__has_include)
+#if __has_include(<sys/rseq.h>) && __has_include(<linux/membarrier.h>)
+#include <sys/rseq.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+#define CPUCACHE_RSEQ 1
+#endif
+#endif
 
-    // Get the pagesize
-    pagesize = getpagesize();
+#define CPUCACHE_MAX 64
 
-    // Calculate padsize as the padding required to round up sizeOfRegion 
-    // to a multiple of pagesize
-    padsize = sizeOfRegion % pagesize;
-    padsize = (pagesize - padsize) % pagesize;
+typedef struct cpuCache {
+    int draining;   // set while cpuReap empties the stacks, see there
+    long counts[TCACHE_CLASSES];
+    void *slots[TCACHE_CLASSES][CPUCACHE_MAX];
+} cpuCache;
 
-    allocsize = sizeOfRegion + padsize;
+static cpuCache *cpuCaches;
+static int cpuCount;
 
-    // Using mmap to allocate memory
-    fd = open("/dev/zero", O_RDWR);
-    if (-1 == fd) {
-        fprintf(stderr, "Error:mem.c: Cannot open /dev/zero\n");
-        return -1;
-    }
-    mmap_ptr = mmap(NULL, allocsize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
-    if (MAP_FAILED == mmap_ptr) {
-        fprintf(stderr, "Error:mem.c: mmap cannot allocate space\n");
-        allocated_once = 0;
-        return -1;
-    }
-  
-    allocated_once = 1;
+/*
+ * With MYHEAP_OPT_ARENAS myAlloc, myFree, coalesce and dispMem work on an
+ * arena owned by the calling thread instead of the shared default heap.
+ * An arena is a heap of its own, set up like the default heap with the
+ * size and options myInit got.  Only its owner touches its blocks and its
+ * free block index, so it is used without the lock.  The default heap is
+ * the first arena.
+ *
+ * A block freed by a thread that does not own its arena is pushed onto the
+ * arena's remoteFrees instead, a lock-free list linked through the blocks'
+ * payload like the free lists.  Any thread pushes with a compare-and-swap
+ * and only the owner takes the whole list with a single exchange, nothing
+ * is ever popped singly so the list needs no ABA protection.  The owner
+ * frees the listed blocks at the start of its next myAlloc or coalesce.
+ *
+ * The arena of a thread that exits is left without an owner until the
+ * next thread that needs an arena adopts it, blocks freed into it in the
+ * meantime wait in its list.  Arenas are never unmapped, arenas[] holds
+ * all of them so that myFree can find the arena of a block.
+ *
+ * With MYHEAP_OPT_STEAL a thread whose arena has no block left allocates
+ * from the arenas of other threads instead of failing, see arenaSteal.
+ * Owners then take their arena's lock too, which is uncontended unless a
+ * thief is at work.  A stolen block still belongs to the arena it came
+ * from and goes back there through remoteFrees when it is freed, so the
+ * free memory of idle threads is used without mapping any more: a thief
+ * never grows the arena of a peer, and with MYHEAP_OPT_MAX_SIZE it only
+ * grows its own once no peer has room.
+ */
+#define MAX_ARENAS 256
 
-    // for double word alignment and end mark
-    allocsize -= 8;
+static myHeap *arenas[MAX_ARENAS];
+static int arenaCount;
+static hsize arenaSize;
+static pthread_mutex_t arenaLock = PTHREAD_MUTEX_INITIALIZER;
+static __thread myHeap *arena;
 
-    // Initially there is only one big free block in the heap.
-    // Skip first 4 bytes for double word alignment requirement.
-    heapStart = (blockHeader*) mmap_ptr + 1;
+/*
+ * With MYHEAP_OPT_SHARDS myInit splits the region into that many shards
+ * of equal size, each a heap of its own with its own lock, free block
+ * index and coalesce() domain.  The default heap is the first shard.
+ * Unlike arenas the number of shards is fixed and they are shared by all
+ * threads, so the region is not multiplied by the number of threads.
+ * myAlloc tries the thread's home shard, picked by thread id, and moves
+ * on to the next shard whose lock is free, or that has room, instead of
+ * waiting.  myFree goes to the shard whose range holds the block.
+ *
+ * Every shard is its own mapping that ends in its own end mark, so no
+ * block ever spans two shards and coalescing stops at a shard boundary
+ * like it stops at the end of a heap.  A request larger than a shard
+ * fails even if the shards together would have room for it.  Shards that
+ * cannot be mapped are left out, MYHEAP_STAT_SHARDS tells how many there
+ * are.
+ *
+ * The caches in front of the default heap and flat combining would only
+ * ever serve the first shard, and myAlloc and myFree go to the shards
+ * without them, so myInit leaves them off.  Picking a shard by thread id
+ * and moving on instead of waiting already keeps threads off each
+ * other's locks.
+ */
+#define MAX_SHARDS 64
 
-    // Set the end mark
-    endMark = (blockHeader*)((void*)heapStart + allocsize);
-    endMark->size_status = 1;
+static myHeap *shards[MAX_SHARDS];
+static int shardCount;
 
-    // Set size in header
-    heapStart->size_status = allocsize;
+/*
+ * With MYHEAP_OPT_WALK_THREADS coalesce(), dispMem() and the usage
+ * counters of myStat() walk a large heap in parallel.  The heap is split
+ * by address into chunks of at least WALK_MIN_CHUNK bytes, and startMap,
+ * a bit per 8 bytes of the reservation like prevMap, set where a block
+ * starts, leads every chunk to its first block without walking the ones
+ * in front of it.  A chunk walks the blocks that start in it, the last
+ * one may reach into the next chunk.  The chunks are handed out to a pool
+ * of walker threads and to the calling thread, and their results are put
+ * together in address order once all of them are done.  The walkers are
+ * started by the first walk that needs them and wait for the next one
+ * after that.  They are shared by all heaps, walks run one at a time.
+ *
+ * The walkers of coalesce() only collect the run heads, merging changes
+ * the free block index and is left to the calling thread, which merges
+ * them in address order.  A heap without a startMap, or too small to be
+ * split, is walked by the calling thread alone.
+ */
+#define WALK_MAX_THREADS 64
+#define WALK_CHUNKS 4
+#define WALK_MIN_CHUNK (256 * 1024)
 
-    // Set p-bit as allocated in header
-    // note a-bit left at 0 for free
-    heapStart->size_status += 2;
+typedef struct walkChunk {
+    hsize begin;            // offsets of the first and past the last byte
+    hsize end;
+    long blocks;            // blocks starting in the chunk
+    hsize usedSize;
+    hsize freeSize;
+    hsize largestFree;
+    hsize *heads;           // run heads found by walkRuns
+    long headCount;
+    long firstNumber;       // number dispMem gives the chunk's first block
+    FILE *out;              // where walkBlocks lists the blocks, NULL for nowhere
+    char *text;             // the list, kept by open_memstream
+    size_t textSize;
+} walkChunk;
 
-    // Set the footer
-    blockHeader *footer = (blockHeader*) ((void*)heapStart + allocsize - 4);
-    footer->size_status = allocsize;
-  
-    return 0;
-} 
-                  
-/* 
- * Function to be used for DEBUGGING to help you visualize your heap structure.
- * Prints out a list of all the blocks including this information:
- * No.      : serial number of the block 
- * Status   : free/used (allocated)
- * Prev     : status of previous block free/used (allocated)
- * t_Begin  : address of the first byte in the block (where the header starts) 
- * t_End    : address of the last byte in the block 
- * t_Size   : size of the block as stored in the block header
- */                     
-void dispMem() {     
- 
-    int counter;
-    char status[6];
-    char p_status[6];
-    char *t_begin = NULL;
-    char *t_end   = NULL;
-    int t_size;
+typedef struct walkJob {
+    myHeap *heap;
+    void (*pass)(walkChunk *chunk);
+    int count;              // chunks to walk
+    int next;               // next chunk to hand out
+    int done;               // chunks walked
+    int busy;               // walkers working on the job
+} walkJob;
 
-    blockHeader *current = heapStart;
-    counter = 1;
+static walkChunk walkChunks[WALK_MAX_THREADS * WALK_CHUNKS];
+static pthread_mutex_t walkLock = PTHREAD_MUTEX_INITIALIZER;
 
-    int used_size = 0;
-    int free_size = 0;
-    int is_used   = -1;
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t poolWake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t poolDone = PTHREAD_COND_INITIALIZER;
+static walkJob *poolJob;
+static unsigned long poolGeneration;
+static int poolThreads;
 
-    fprintf(stdout, 
-	"*********************************** Block List **********************************\n");
-    fprintf(stdout, "No.\tStatus\tPrev\tt_Begin\t\tt_End\t\tt_Size\n");
-    fprintf(stdout, 
-	"---------------------------------------------------------------------------------\n");
-  
-    while (current->size_status != 1) {
-        t_begin = (char*)current;
-        t_size = current->size_status;
-    
-        if (t_size & 1) {
-            // LSB = 1 => used block
-            strcpy(status, "alloc");
-            is_used = 1;
-            t_size = t_size - 1;
-        } else {
-            strcpy(status, "FREE ");
-            is_used = 0;
-        }
+// size of a block with the status bits masked off
+static hsize blockSize(blockHeader *block) {
+    return block->size_status - block->size_status % 8;
+}
 
-        if (t_size & 2) {
-            strcpy(p_status, "alloc");
-            t_size = t_size - 2;
-        } else {
-            strcpy(p_status, "FREE ");
-        }
+// link area stored at the start of a free block's payload
+static freeLinks* linksOf(blockHeader *block) {
+    return (freeLinks*)((void*)block + sizeof(blockHeader));
+}
 
-        if (is_used) 
-            used_size += t_size;
-        else 
-            free_size += t_size;
+static blockHeader* blockAt(hsize offset) {
+    return (blockHeader*)((void*)heap->heapStart + offset);
+}
 
-        t_end = t_begin + t_size - 1;
-    
-        fprintf(stdout, "%d\t%s\t%s\t0x%08lx\t0x%08lx\t%4i\n", counter, status, 
-        p_status, (unsigned long int)t_begin, (unsigned long int)t_end, t_size);
-    
-        current = (blockHeader*)((char*)current + t_size);
-        counter = counter + 1;
+static hsize offsetOf(blockHeader *block) {
+    return (void*)block - (void*)heap->heapStart;
+}
+
+// the p-bit of a block, whether the block in front of it is allocated
+static int prevAllocated(blockHeader *block) {
+    hsize bit = offsetOf(block) / 8;
+    return (heap->prevMap[bit / 8] >> (bit % 8)) & 1;
+}
+
+static void setPrevAllocated(blockHeader *block, int allocated) {
+    hsize bit = offsetOf(block) / 8;
+    if (allocated) {
+        heap->prevMap[bit / 8] |= 1 << (bit % 8);
+    } else {
+        heap->prevMap[bit / 8] &= ~(1 << (bit % 8));
     }
+}
 
-    fprintf(stdout, 
-	"---------------------------------------------------------------------------------\n");
+// whether a block has an entry in the dirty queue
+static int isQueued(blockHeader *block) {
+    if (heap->queuedMap == NULL) {
+        return 0;
+    }
+    hsize bit = offsetOf(block) / 8;
+    return (heap->queuedMap[bit / 8] >> (bit % 8)) & 1;
+}
+
+static void setQueued(blockHeader *block, int queued) {
+    hsize bit = offsetOf(block) / 8;
+    if (queued) {
+        heap->queuedMap[bit / 8] |= 1 << (bit % 8);
+    } else {
+        heap->queuedMap[bit / 8] &= ~(1 << (bit % 8));
+    }
+}
+
+// records whether a block starts here, for heaps walked in parallel
+static void setBlockStart(blockHeader *block, int start) {
+    if (heap->startMap == NULL) {
+        return;
+    }
+    hsize bit = offsetOf(block) / 8;
+    if (start) {
+        heap->startMap[bit / 8] |= 1 << (bit % 8);
+    } else {
+        heap->startMap[bit / 8] &= ~(1 << (bit % 8));
+    }
+}
+
+// index of the highest set bit of a positive size
+static int log2Floor(hsize size) {
+    return 63 - __builtin_clzll(size);
+}
+
+// start of the mapping, the heap starts after padding that aligns payloads
+static void* heapBase() {
+    return (void*)heap->heapStart - (8 - sizeof(blockHeader));
+}
+
+// bin that a free block of the given size below SMALL_LIMIT belongs to
+static int binIndex(hsize size) {
+    return size / 8 - 2;
+}
+
+// first non-empty bin at or after index, or -1 if there is none
+static int nextBin(int index) {
+    int word = index / 32;
+    unsigned int bits = heap->binmap[word] & (~0u << (index % 32));
+
+    while (bits == 0) {
+        if (++word >= (int)(sizeof(heap->binmap) / sizeof(heap->binmap[0]))) {
+            return -1;
+        }
+        bits = heap->binmap[word];
+    }
+    return word * 32 + __builtin_ctz(bits);
+}
+
+// pushes a free block (header and footer already written) onto its bin
+static void binInsert(blockHeader *block) {
+    int index = binIndex(blockSize(block));
+    freeLinks *links = linksOf(block);
+
+    links->prev = NO_BLOCK;
+    links->next = heap->bins[index];
+    if (heap->bins[index] != NO_BLOCK) {
+        linksOf(blockAt(heap->bins[index]))->prev = offsetOf(block);
+    }
+    heap->bins[index] = offsetOf(block);
+    heap->binmap[index / 32] |= 1u << (index % 32);
+}
+
+// unlinks a free block from its bin, must be called before its size changes
+static void binRemove(blockHeader *block) {
+    int index = binIndex(blockSize(block));
+    freeLinks *links = linksOf(block);
+
+    if (links->prev != NO_BLOCK) {
+        linksOf(blockAt(links->prev))->next = links->next;
+    } else {
+        heap->bins[index] = links->next;
+    }
+    if (links->next != NO_BLOCK) {
+        linksOf(blockAt(links->next))->prev = links->prev;
+    }
+    if (heap->bins[index] == NO_BLOCK) {
+        heap->binmap[index / 32] &= ~(1u << (index % 32));
+    }
+}
+
+/*
+ * Finds the best-fit free block below SMALL_LIMIT bytes for a block of
+ * 'size' bytes.  Every block in the first non-empty bin at or after the
+ * one for 'size' fits and none fits better, so no list is searched.
+ * Returns NULL if no bin has a block, larger blocks are in the tree.
+ */
+static blockHeader* binBestFit(hsize size) {
+    if (size >= SMALL_LIMIT) {
+        return NULL;
+    }
+    int index = nextBin(binIndex(size));
+    return index == -1 ? NULL : blockAt(heap->bins[index]);
+}
+
+// tree node stored at the start of a free block's payload
+static treeNode* nodeOf(hsize offset) {
+    return (treeNode*)linksOf(blockAt(offset));
+}
+
+static int treeHeight(hsize offset) {
+    return offset == NO_BLOCK ? 0 : nodeOf(offset)->height / 2;
+}
+
+// orders blocks by size first and by address among equal sizes
+static int treeLess(hsize a, hsize b) {
+    hsize a_size = blockSize(blockAt(a));
+    hsize b_size = blockSize(blockAt(b));
+    return a_size < b_size || (a_size == b_size && a < b);
+}
+
+static void treeUpdate(hsize offset) {
+    treeNode *node = nodeOf(offset);
+    int left = treeHeight(node->left);
+    int right = treeHeight(node->right);
+    node->height = 2 * (1 + (left > right ? left : right));
+}
+
+// rotates the subtree at offset and returns its new root
+static hsize treeRotateLeft(hsize offset) {
+    hsize root = nodeOf(offset)->right;
+    nodeOf(offset)->right = nodeOf(root)->left;
+    nodeOf(root)->left = offset;
+    treeUpdate(offset);
+    treeUpdate(root);
+    return root;
+}
+
+static hsize treeRotateRight(hsize offset) {
+    hsize root = nodeOf(offset)->left;
+    nodeOf(offset)->left = nodeOf(root)->right;
+    nodeOf(root)->right = offset;
+    treeUpdate(offset);
+    treeUpdate(root);
+    return root;
+}
+
+// restores the AVL property at offset and returns the subtree's root
+static hsize treeBalance(hsize offset) {
+    treeNode *node = nodeOf(offset);
+    int diff = treeHeight(node->left) - treeHeight(node->right);
+
+    if (diff > 1) {
+        treeNode *left = nodeOf(node->left);
+        if (treeHeight(left->left) < treeHeight(left->right)) {
+            node->left = treeRotateLeft(node->left);
+        }
+        return treeRotateRight(offset);
+    }
+    if (diff < -1) {
+        treeNode *right = nodeOf(node->right);
+        if (treeHeight(right->right) < treeHeight(right->left)) {
+            node->right = treeRotateRight(node->right);
+        }
+        return treeRotateLeft(offset);
+    }
+    treeUpdate(offset);
+    return offset;
+}
+
+static hsize treeInsertAt(hsize root, hsize offset) {
+    if (root == NO_BLOCK) {
+        treeNode *node = nodeOf(offset);
+        node->left = NO_BLOCK;
+        node->right = NO_BLOCK;
+        node->height = 2;
+        return offset;
+    }
+    if (treeLess(offset, root)) {
+        nodeOf(root)->left = treeInsertAt(nodeOf(root)->left, offset);
+    } else {
+        nodeOf(root)->right = treeInsertAt(nodeOf(root)->right, offset);
+    }
+    return treeBalance(root);
+}
+
+// detaches the smallest node of a subtree into *min, returns the new root
+static hsize treeRemoveMin(hsize root, hsize *min) {
+    if (nodeOf(root)->left == NO_BLOCK) {
+        *min = root;
+        return nodeOf(root)->right;
+    }
+    nodeOf(root)->left = treeRemoveMin(nodeOf(root)->left, min);
+    return treeBalance(root);
+}
+
+static hsize treeRemoveAt(hsize root, hsize offset) {
+    treeNode *node = nodeOf(root);
+
+    if (root != offset) {
+        if (treeLess(offset, root)) {
+            node->left = treeRemoveAt(node->left, offset);
+        } else {
+            node->right = treeRemoveAt(node->right, offset);
+        }
+        return treeBalance(root);
+    }
+
+    if (node->left == NO_BLOCK) {
+        return node->right;
+    }
+    if (node->right == NO_BLOCK) {
+        return node->left;
+    }
+
+    // the in-order successor takes the removed node's place
+    hsize successor;
+    hsize right = treeRemoveMin(node->right, &successor);
+    nodeOf(successor)->left = node->left;
+    nodeOf(successor)->right = right;
+    return treeBalance(successor);
+}
+
+/*
+ * Finds the smallest free block of at least 'size' bytes in the tree, the
+ * lowest address winning among blocks of that size.
+ * Returns NULL if no free block is large enough.
+ */
+static blockHeader* treeBestFit(hsize size) {
+    hsize best = NO_BLOCK;
+    hsize offset = heap->treeRoot;
+
+    while (offset != NO_BLOCK) {
+        if (blockSize(blockAt(offset)) >= size) {
+            best = offset;
+            offset = nodeOf(offset)->left;
+        } else {
+            offset = nodeOf(offset)->right;
+        }
+    }
+    return best == NO_BLOCK ? NULL : blockAt(best);
+}
+
+// first and second level list index of a block size
+static void tlsfMapping(hsize size, int *fl, int *sl) {
+    if (size < TLSF_SMALL) {
+        *fl = 0;
+        *sl = size / 8;
+        return;
+    }
+    int msb = log2Floor(size);
+    *fl = msb - TLSF_FL_SHIFT + 1;
+    *sl = (size >> (msb - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+}
+
+static void tlsfInsert(blockHeader *block) {
+    int fl, sl;
+    tlsfMapping(blockSize(block), &fl, &sl);
+    freeLinks *links = linksOf(block);
+
+    links->prev = NO_BLOCK;
+    links->next = heap->tlsfLists[fl][sl];
+    if (heap->tlsfLists[fl][sl] != NO_BLOCK) {
+        linksOf(blockAt(heap->tlsfLists[fl][sl]))->prev = offsetOf(block);
+    }
+    heap->tlsfLists[fl][sl] = offsetOf(block);
+    heap->tlsfFlMap |= 1ull << fl;
+    heap->tlsfSlMap[fl] |= 1u << sl;
+}
+
+static void tlsfRemove(blockHeader *block) {
+    int fl, sl;
+    tlsfMapping(blockSize(block), &fl, &sl);
+    freeLinks *links = linksOf(block);
+
+    if (links->prev != NO_BLOCK) {
+        linksOf(blockAt(links->prev))->next = links->next;
+    } else {
+        heap->tlsfLists[fl][sl] = links->next;
+    }
+    if (links->next != NO_BLOCK) {
+        linksOf(blockAt(links->next))->prev = links->prev;
+    }
+    if (heap->tlsfLists[fl][sl] == NO_BLOCK) {
+        heap->tlsfSlMap[fl] &= ~(1u << sl);
+        if (heap->tlsfSlMap[fl] == 0) {
+            heap->tlsfFlMap &= ~(1ull << fl);
+        }
+    }
+}
+
+/*
+ * Finds a free block of at least 'size' bytes in constant time.  The size
+ * is rounded up to the next list boundary so that every block in the list
+ * found is large enough and no list has to be searched.  This is a good
+ * fit rather than a best fit: a block of exactly 'size' bytes sharing a
+ * list with smaller blocks is passed over for the next non-empty list.
+ * Returns NULL if no list holds a large enough block.
+ */
+static blockHeader* tlsfFindFit(hsize size) {
+    int fl, sl;
+    hsize search = size;
+
+    if (size >= TLSF_SMALL) {
+        hsize round = ((hsize)1 << (log2Floor(size) - TLSF_SL_LOG2)) - 1;
+        search = size > HSIZE_MAX - round ? HSIZE_MAX : size + round;
+    }
+    tlsfMapping(search, &fl, &sl);
+
+    unsigned int sl_map = heap->tlsfSlMap[fl] & (~0u << sl);
+    if (sl_map == 0) {
+        // the shift is split in two so that fl + 1 == 64 is well defined
+        unsigned long long fl_map = heap->tlsfFlMap & ((~0ull << fl) << 1);
+        if (fl_map == 0) {
+            // last resort: the head of the list holding 'size' itself, so
+            // that e.g. the whole heap can still be allocated in one block
+            tlsfMapping(size, &fl, &sl);
+            hsize head = heap->tlsfLists[fl][sl];
+            if (head != NO_BLOCK && blockSize(blockAt(head)) >= size) {
+                return blockAt(head);
+            }
+            return NULL;
+        }
+        fl = __builtin_ctzll(fl_map);
+        sl_map = heap->tlsfSlMap[fl];
+    }
+    sl = __builtin_ctz(sl_map);
+    return blockAt(heap->tlsfLists[fl][sl]);
+}
+
+// milliseconds on a monotonic clock, wrapping around is fine for differences
+static unsigned int nowMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// time a large free block was indexed, stored after its links or tree node
+// at an offset that is 4 mod 8, where no header of an absorbed block can
+// have been, so that freeing such a block again never mistakes the stamp
+// for an allocated header
+static unsigned int* stampOf(blockHeader *block) {
+    hsize offset = sizeof(blockHeader) + sizeof(treeNode);
+    return (unsigned int*)((void*)block + (offset + 3) / 8 * 8 + 4);
+}
+
+// whether a free block of the given size is kept in the tree
+static int inTree(hsize size) {
+    return heap->opt.engine == MYHEAP_ENGINE_TREE ||
+           (heap->opt.engine == MYHEAP_ENGINE_BINS && size >= SMALL_LIMIT);
+}
+
+/*
+ * Free block index used by myAlloc, myFree and coalesce, dispatching to the
+ * engine selected with MYHEAP_OPT_ENGINE.  Blocks must be removed before
+ * their size changes and inserted after their header is written.
+ */
+static void freeInsert(blockHeader *block) {
+    if (inTree(blockSize(block))) {
+        heap->treeRoot = treeInsertAt(heap->treeRoot, offsetOf(block));
+    } else if (heap->opt.engine == MYHEAP_ENGINE_TLSF) {
+        tlsfInsert(block);
+    } else {
+        binInsert(block);
+    }
+
+    // only blocks that can hold a whole page besides their metadata
+    if (heap->opt.purgeMode != MYHEAP_PURGE_OFF && blockSize(block) >= 2 * heap->heapPage) {
+        *stampOf(block) = nowMs();
+    }
+}
+
+static void freeRemove(blockHeader *block) {
+    if (inTree(blockSize(block))) {
+        heap->treeRoot = treeRemoveAt(heap->treeRoot, offsetOf(block));
+    } else if (heap->opt.engine == MYHEAP_ENGINE_TLSF) {
+        tlsfRemove(block);
+    } else {
+        binRemove(block);
+    }
+}
+
+static blockHeader* findBestFit(hsize size) {
+    switch (heap->opt.engine) {
+    case MYHEAP_ENGINE_TREE:
+        return treeBestFit(size);
+    case MYHEAP_ENGINE_TLSF:
+        return tlsfFindFit(size);
+    default: {
+        // every block in the tree is larger than any in the bins
+        blockHeader *best = binBestFit(size);
+        return best != NULL ? best : treeBestFit(size);
+    }
+    }
+}
+
+// TLSF needs immediate merging to keep its constant time bound
+static int mergesOnFree() {
+    return heap->opt.coalesceMode == MYHEAP_COALESCE_IMMEDIATE ||
+           heap->opt.engine == MYHEAP_ENGINE_TLSF;
+}
+
+/*
+ * Merges a free block that is not in the free block index yet with the
+ * free blocks directly before and after it, using the p-bit and the
+ * previous block's footer.  Takes a constant number of steps.
+ * Returns the merged block, which still has to be inserted.
+ */
+static blockHeader* mergeNeighbours(blockHeader *block) {
+    hsize size = blockSize(block);
+    blockHeader *next = (void*)block + size;
+
+    // the end mark has its a-bit set so it is never absorbed,
+    // queued blocks are left for their own dirty queue entry
+    if ((next->size_status & 1) == 0 && !isQueued(next)) {
+        freeRemove(next);
+        size += blockSize(next);
+        setBlockStart(next, 0);
+    }
+
+    if (!prevAllocated(block)) {
+        blockHeader *prevFooter = (void*)block - sizeof(blockHeader);
+        blockHeader *prev = (void*)block - prevFooter->size_status;
+        if (!isQueued(prev)) {
+            freeRemove(prev);
+            size += blockSize(prev);
+            setBlockStart(block, 0);
+            block = prev;
+        }
+    }
+
+    // whichever block now starts the merged block keeps its p-bit
+    block->size_status = size;
+    blockHeader *footer = (void*)block + size - sizeof(blockHeader);
+    footer->size_status = size;
+    return block;
+}
+
+/*
+ * Merges the block of the oldest dirty queue entry with its neighbours.
+ * Returns the merged block, or NULL if the block had been allocated.
+ */
+static blockHeader* dirtyProcess() {
+    blockHeader *block = blockAt(heap->dirtyQueue[heap->dirtyHead]);
+    heap->dirtyHead = (heap->dirtyHead + 1) % DIRTY_QUEUE_SIZE;
+    heap->dirtyCount--;
+
+    setQueued(block, 0);
+
+    // allocated again since it was queued, its neighbours are not ours to merge
+    if (block->size_status & 1) {
+        return NULL;
+    }
+    freeRemove(block);
+    block = mergeNeighbours(block);
+    freeInsert(block);
+    return block;
+}
+
+/*
+ * Queues a free block that is already in the free block index.  A full
+ * queue first gives up its oldest entry, which costs a single merge.
+ */
+static void dirtyPush(blockHeader *block) {
+    // marked first so that the merge below cannot absorb it
+    setQueued(block, 1);
+    if (heap->dirtyCount == DIRTY_QUEUE_SIZE) {
+        dirtyProcess();
+    }
+    heap->dirtyQueue[(heap->dirtyHead + heap->dirtyCount) % DIRTY_QUEUE_SIZE] = offsetOf(block);
+    heap->dirtyCount++;
+}
+
+/*
+ * Merges the free block at ptr with all free blocks that directly follow it
+ * and puts the result back into the free block index.
+ */
+static void mergeRun(blockHeader *ptr) {
+	hsize ptr_size = blockSize(ptr);
+
+	//pointer to the next block
+	blockHeader *next = (void*) ptr + ptr_size;
+
+	//the run head is reindexed once its final size is known
+	freeRemove(ptr);
+
+	//the end mark and allocated blocks both have the a bit set
+	while((next -> size_status & 1) == 0){
+		freeRemove(next);
+		ptr_size += blockSize(next);
+		setBlockStart(next, 0);
+		next = (void*) ptr + ptr_size;
+	}
+
+	//header keeps its p-bit, the footer of the last absorbed block becomes ours
+	ptr -> size_status = ptr_size;
+	blockHeader *footer = (void*) ptr + ptr_size - sizeof(blockHeader);
+	footer -> size_status = ptr_size;
+
+	freeInsert(ptr);
+}
+
+// a free block that starts a run of at least two free blocks
+static int isRunHead(blockHeader *ptr) {
+	blockHeader *next = (void*) ptr + blockSize(ptr);
+	return prevAllocated(ptr) && (next -> size_status & 1) == 0;
+}
+
+// first block after the run of free blocks starting at ptr
+static blockHeader* runEnd(blockHeader *ptr) {
+	while((ptr -> size_status & 1) == 0){
+		ptr = (void*) ptr + blockSize(ptr);
+	}
+	return ptr;
+}
+
+// a run head in the subtree whose run adds up to at least 'size' bytes
+static hsize treeFindRun(hsize offset, hsize size) {
+	while(offset != NO_BLOCK){
+		blockHeader *ptr = blockAt(offset);
+		if(isRunHead(ptr) && (void*) runEnd(ptr) - (void*) ptr >= size){
+			return offset;
+		}
+		hsize found = treeFindRun(nodeOf(offset) -> left, size);
+		if(found != NO_BLOCK){
+			return found;
+		}
+		offset = nodeOf(offset) -> right;
+	}
+	return NO_BLOCK;
+}
+
+// MYHEAP_RETRY_* of the calling thread's current myAlloc, see
+// MYHEAP_STAT_LAST_RETRY
+static __thread int lastRetry;
+
+/*
+ * Used by myAlloc with MYHEAP_OPT_RETRY once no free block fits.  Merges
+ * free blocks only until one of at least 'size' bytes exists: queued blocks
+ * one at a time with incremental coalescing, otherwise the first run of
+ * free blocks that adds up to 'size'.  Nothing else in the heap is touched.
+ * Returns the merged block, still in the free block index, or NULL.
+ */
+static blockHeader* mergeForFit(hsize size) {
+	//immediate merging leaves nothing to merge
+	if(mergesOnFree()){
+		return NULL;
+	}
+	heap->retryCount++;
+	if(lastRetry == MYHEAP_RETRY_NONE){
+		lastRetry = MYHEAP_RETRY_MISS;
+	}
+
+	if(heap->opt.coalesceMode == MYHEAP_COALESCE_INCREMENTAL){
+		while(heap->dirtyCount > 0){
+			blockHeader *merged = dirtyProcess();
+			if(merged != NULL && blockSize(merged) >= size){
+				heap->retryHits++;
+				lastRetry = MYHEAP_RETRY_HIT;
+				return merged;
+			}
+		}
+		return NULL;
+	}
+
+	//the bins engine keeps its small blocks in the bins and the rest in the tree
+	blockHeader *head = NULL;
+	for(int index = nextBin(0); index != -1 && head == NULL; index = nextBin(index + 1)){
+		for(hsize offset = heap->bins[index]; offset != NO_BLOCK; offset = linksOf(blockAt(offset)) -> next){
+			blockHeader *ptr = blockAt(offset);
+			if(isRunHead(ptr) && (void*) runEnd(ptr) - (void*) ptr >= size){
+				head = ptr;
+				break;
+			}
+		}
+	}
+	if(head == NULL){
+		hsize offset = treeFindRun(heap->treeRoot, size);
+		if(offset == NO_BLOCK){
+			return NULL;
+		}
+		head = blockAt(offset);
+	}
+
+	//the run head keeps its address, so it is the merged block
+	mergeRun(head);
+	heap->retryHits++;
+	lastRetry = MYHEAP_RETRY_HIT;
+	return head;
+}
+
+/*
+ * Grows the heap into its reservation so that a free block of at least
+ * 'size' bytes exists, merged with a free block at the end of the heap.
+ * Returns the new free block, already in the free block index, or NULL if
+ * the reservation is used up or mprotect fails.
+ */
+static blockHeader* growHeap(hsize size) {
+    hsize pagesize = heap->heapPage;
+    hsize mapped = heap->allocsize + 8;
+    void *base = heapBase();
+
+    // a free last block makes up part of the size unless it is still queued
+    hsize need = size;
+    blockHeader *last = (void*)heap->heapStart + heap->allocsize - sizeof(blockHeader);
+    if (!heap->lastAllocated && !isQueued(blockAt(heap->allocsize - last->size_status))) {
+        need -= last->size_status;
+    }
+
+    // doubles the heap, or more if the request needs it
+    hsize grow = mapped;
+    if (grow < need) {
+        grow = need;
+    }
+    // the reservation and the mapped part are both whole pages
+    if (grow > heap->reservesize - mapped) {
+        grow = heap->reservesize - mapped;
+    } else {
+        grow = (grow + pagesize - 1) / pagesize * pagesize;
+    }
+    if (grow <= 0 || grow < need) {
+        return NULL;
+    }
+
+    if (mprotect(base + mapped, grow, PROT_READ | PROT_WRITE) != 0) {
+        return NULL;
+    }
+    heap->growCount++;
+
+    // the old end mark is the header of the new free block
+    blockHeader *block = blockAt(heap->allocsize);
+    heap->allocsize += grow;
+    block->size_status = grow;
+    setPrevAllocated(block, heap->lastAllocated);
+    setBlockStart(block, 1);
+    blockHeader *footer = (void*)block + grow - sizeof(blockHeader);
+    footer->size_status = grow;
+    blockAt(heap->allocsize)->size_status = 1;
+    heap->lastAllocated = 0;
+
+    block = mergeNeighbours(block);
+    freeInsert(block);
+    return block;
+}
+
+// page number of an address, counted from the start of the reservation
+static long pageOf(void *addr) {
+    return (addr - heapBase()) / heap->heapPage;
+}
+
+static int isPurged(long page) {
+    return (heap->purgedMap[page / 8] >> (page % 8)) & 1;
+}
+
+/*
+ * Purges the whole pages inside a free block that has been free long
+ * enough, leaving the pages holding its header, links, stamp and footer.
+ */
+static void purgeBlock(blockHeader *block, unsigned int now) {
+    if (now - *stampOf(block) < (unsigned int)heap->opt.purgeDecay) {
+        return;
+    }
+
+    long pagesize = heap->heapPage;
+    void *base = heapBase();
+    long first = pageOf((void*)stampOf(block) + sizeof(unsigned int) + pagesize - 1);
+    long last = pageOf((void*)block + blockSize(block) - sizeof(blockHeader));
+    int advice = heap->opt.purgeMode == MYHEAP_PURGE_DONTNEED ? MADV_DONTNEED : MADV_FREE;
+
+    // one madvise for each run of pages that are not purged yet
+    long page = first;
+    while (page < last) {
+        if (isPurged(page)) {
+            page++;
+            continue;
+        }
+        long start = page;
+        while (page < last && !isPurged(page)) {
+            heap->purgedMap[page / 8] |= 1 << (page % 8);
+            page++;
+        }
+        madvise(base + start * pagesize, (page - start) * pagesize, advice);
+        heap->purgedPages += page - start;
+    }
+}
+
+// purges the free blocks of a subtree that are at least 'size' bytes
+static void treePurge(hsize offset, hsize size, unsigned int now) {
+    while (offset != NO_BLOCK) {
+        treeNode *node = nodeOf(offset);
+        if (blockSize(blockAt(offset)) < size) {
+            offset = node->right;
+            continue;
+        }
+        treePurge(node->left, size, now);
+        purgeBlock(blockAt(offset), now);
+        offset = node->right;
+    }
+}
+
+/*
+ * Cuts a free block at the end of the heap off at the first page boundary
+ * after its header and gives the pages after it back, leaving them
+ * inaccessible like the unused part of the reservation.
+ */
+static void purgeTail(unsigned int now) {
+    hsize pagesize = heap->heapPage;
+
+    // a stalled stack pop may still read a block in the tail
+    if (heap->lastAllocated || heap->opt.stackCount > 0) {
+        return;
+    }
+    blockHeader *footer = (void*)heap->heapStart + heap->allocsize - sizeof(blockHeader);
+    blockHeader *block = blockAt(heap->allocsize - footer->size_status);
+
+    // a queued block has to keep its header for its dirty queue entry
+    if (blockSize(block) < 2 * pagesize || isQueued(block) ||
+        now - *stampOf(block) < (unsigned int)heap->opt.purgeDecay) {
+        return;
+    }
+
+    // the end mark needs the last 4 bytes of the new mapping and the
+    // shortened block has to stay a valid block if it is kept at all
+    hsize offset = offsetOf(block);
+    hsize mapped = heap->allocsize + 8;
+    hsize keep = (offset + 8 + pagesize - 1) / pagesize * pagesize;
+    hsize tail = keep - 8 - offset;
+    if (tail > 0 && tail < heap->minBlock) {
+        keep += pagesize;
+        tail += pagesize;
+    }
+    if (keep >= mapped) {
+        return;
+    }
+
+    freeRemove(block);
+    if (tail > 0) {
+        block->size_status = tail;
+        footer = (void*)block + tail - sizeof(blockHeader);
+        footer->size_status = tail;
+        freeInsert(block);
+    } else {
+        heap->lastAllocated = prevAllocated(block);
+        setBlockStart(block, 0);
+    }
+    heap->allocsize = keep - 8;
+    blockAt(heap->allocsize)->size_status = 1;
+
+    void *base = heapBase();
+    madvise(base + keep, mapped - keep, MADV_DONTNEED);
+    mprotect(base + keep, mapped - keep, PROT_NONE);
+    for (long page = keep / pagesize; page < mapped / pagesize; page++) {
+        heap->purgedMap[page / 8] &= ~(1 << (page % 8));
+    }
+    heap->purgedPages += (mapped - keep) / pagesize;
+}
+
+/*
+ * Called from myFree and coalesce.  At most every quarter of the decay
+ * time, shrinks the heap and purges all free blocks of two pages or more
+ * that have been free for the decay time.
+ */
+static void maybePurge() {
+    if (heap->opt.purgeMode == MYHEAP_PURGE_OFF) {
+        return;
+    }
+    unsigned int now = nowMs();
+    if (now - heap->lastPurge < (unsigned int)heap->opt.purgeDecay / 4) {
+        return;
+    }
+    heap->lastPurge = now;
+
+    purgeTail(now);
+
+    // blocks of two pages are past the bins, the bins engine has them in the tree
+    hsize size = 2 * heap->heapPage;
+    switch (heap->opt.engine) {
+    case MYHEAP_ENGINE_TLSF: {
+        int fl, sl;
+        tlsfMapping(size, &fl, &sl);
+        for (; fl < TLSF_FL_COUNT; fl++, sl = 0) {
+            for (; sl < TLSF_SL_COUNT; sl++) {
+                for (hsize offset = heap->tlsfLists[fl][sl]; offset != NO_BLOCK;
+                     offset = linksOf(blockAt(offset))->next) {
+                    if (blockSize(blockAt(offset)) >= size) {
+                        purgeBlock(blockAt(offset), now);
+                    }
+                }
+            }
+        }
+        break;
+    }
+    default:
+        treePurge(heap->treeRoot, size, now);
+    }
+}
+
+// counts the purged pages a new allocation hands out again as refaulted
+static void countRefaults(void *block, hsize size) {
+    long last = pageOf(block + size - 1);
+    for (long page = pageOf(block); page <= last; page++) {
+        if (isPurged(page)) {
+            heap->purgedMap[page / 8] &= ~(1 << (page % 8));
+            heap->refaultedPages++;
+        }
+    }
+}
+
+// chains the run heads of a subtree together through their 'run' field
+static hsize treeCollectRuns(hsize offset, hsize chain) {
+	while(offset != NO_BLOCK){
+		treeNode *node = nodeOf(offset);
+		chain = treeCollectRuns(node -> left, chain);
+		if(isRunHead(blockAt(offset))){
+			node -> run = chain;
+			chain = offset;
+		}
+		offset = node -> right;
+	}
+	return chain;
+}
+
+// offset of the first block that starts in [begin, end), end if none does
+static hsize chunkFirst(hsize begin, hsize end) {
+    // the first block is found without the map
+    if (begin == 0) {
+        return 0;
+    }
+    hsize bit = begin / 8;
+    while (bit < end / 8) {
+        unsigned int bits = heap->startMap[bit / 8] >> (bit % 8);
+        if (bits != 0) {
+            bit += __builtin_ctz(bits);
+            return bit < end / 8 ? bit * 8 : end;
+        }
+        bit += 8 - bit % 8;
+    }
+    return end;
+}
+
+/*
+ * Counts the blocks that start in a chunk and the bytes in them, and lists
+ * them the way dispMem does when the chunk has an output.
+ */
+static void walkBlocks(walkChunk *chunk) {
+    long number = chunk->firstNumber;
+    hsize offset = chunkFirst(chunk->begin, chunk->end);
+
+    while (offset < chunk->end) {
+        blockHeader *current = blockAt(offset);
+        hsize size = blockSize(current);
+        int used = current->size_status & 1;
+
+        chunk->blocks++;
+        if (used) {
+            chunk->usedSize += size;
+        } else {
+            chunk->freeSize += size;
+            if (size > chunk->largestFree) {
+                chunk->largestFree = size;
+            }
+        }
+
+        if (chunk->out != NULL) {
+            fprintf(chunk->out, "%ld\t%s\t%s\t0x%08lx\t0x%08lx\t%4li\n", number,
+                    used ? "alloc" : "FREE ", prevAllocated(current) ? "alloc" : "FREE ",
+                    (unsigned long int)current, (unsigned long int)current + size - 1, (long)size);
+        }
+        number++;
+        offset += size;
+    }
+}
+
+// collects the run heads that start in a chunk, see walkCoalesce
+static void walkRuns(walkChunk *chunk) {
+    hsize offset = chunkFirst(chunk->begin, chunk->end);
+
+    while (offset < chunk->end) {
+        blockHeader *ptr = blockAt(offset);
+        if ((ptr->size_status & 1) == 0 && isRunHead(ptr)) {
+            chunk->heads[chunk->headCount++] = offset;
+        }
+        offset += blockSize(ptr);
+    }
+}
+
+// walks chunks of a job until none are left
+static void walkTake(walkJob *job) {
+    heap = job->heap;
+    int index;
+    while ((index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count) {
+        job->pass(&walkChunks[index]);
+        __atomic_add_fetch(&job->done, 1, __ATOMIC_RELEASE);
+    }
+}
+
+// a walker of the pool, joins every job published after it started
+static void* walkWorker(void *unused) {
+    (void)unused;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&poolLock);
+    for (;;) {
+        while (poolJob == NULL || poolGeneration == seen) {
+            pthread_cond_wait(&poolWake, &poolLock);
+        }
+        seen = poolGeneration;
+        walkJob *job = poolJob;
+        job->busy++;
+        pthread_mutex_unlock(&poolLock);
+
+        walkTake(job);
+
+        pthread_mutex_lock(&poolLock);
+        job->busy--;
+        pthread_cond_broadcast(&poolDone);
+    }
+    return NULL;
+}
+
+// number of chunks the current heap is walked in, 1 for no parallel walk
+static int walkSplit() {
+    if (heap->startMap == NULL) {
+        return 1;
+    }
+    long count = heap->opt.walkThreads * WALK_CHUNKS;
+    if (count > heap->allocsize / WALK_MIN_CHUNK) {
+        count = heap->allocsize / WALK_MIN_CHUNK;
+    }
+    return count > 1 ? count : 1;
+}
+
+// takes walkLock and splits the current heap into 'count' chunks
+static void walkBegin(int count) {
+    pthread_mutex_lock(&walkLock);
+    for (int i = 0; i < count; i++) {
+        walkChunk *chunk = &walkChunks[i];
+        memset(chunk, 0, sizeof(walkChunk));
+        chunk->begin = heap->allocsize / count * i / 8 * 8;
+        chunk->end = i == count - 1 ? heap->allocsize : heap->allocsize / count * (i + 1) / 8 * 8;
+    }
+}
+
+static void walkEnd() {
+    pthread_mutex_unlock(&walkLock);
+}
+
+/*
+ * Runs a pass over the chunks set up by walkBegin, on the walkers and the
+ * calling thread, and returns once every chunk is done.
+ */
+static void walkHeap(void (*pass)(walkChunk *chunk), int count) {
+    walkJob job = { .heap = heap, .pass = pass, .count = count };
+
+    pthread_mutex_lock(&poolLock);
+    // the caller walks too, so it needs one walker less
+    while (poolThreads < heap->opt.walkThreads - 1) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, walkWorker, NULL) != 0) {
+            break;
+        }
+        pthread_detach(thread);
+        poolThreads++;
+    }
+    poolJob = &job;
+    poolGeneration++;
+    pthread_cond_broadcast(&poolWake);
+    pthread_mutex_unlock(&poolLock);
+
+    walkTake(&job);
+
+    // the job lives on this stack, so no walker may still be looking at it
+    pthread_mutex_lock(&poolLock);
+    while (__atomic_load_n(&job.done, __ATOMIC_ACQUIRE) < count || job.busy > 0) {
+        pthread_cond_wait(&poolDone, &poolLock);
+    }
+    poolJob = NULL;
+    pthread_mutex_unlock(&poolLock);
+}
+
+/*
+ * Delayed coalesce() of a heap split into 'count' chunks.  The walkers
+ * collect the run heads, which are then merged in address order; a run
+ * head is never absorbed since its previous block is allocated.
+ * Returns 0 if there was no room for the run heads.
+ */
+static int walkCoalesce(int count) {
+    // a run head and the free block after it take at least 32 bytes, so a
+    // chunk's heads fit in one slot per 16 bytes of it
+    hsize room = (heap->allocsize / 16 + 1) * sizeof(hsize);
+    hsize *heads = mmap(NULL, room, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (MAP_FAILED == heads) {
+        return 0;
+    }
+
+    walkBegin(count);
+    for (int i = 0; i < count; i++) {
+        walkChunks[i].heads = heads + walkChunks[i].begin / 16;
+    }
+    walkHeap(walkRuns, count);
+    for (int i = 0; i < count; i++) {
+        for (long j = 0; j < walkChunks[i].headCount; j++) {
+            mergeRun(blockAt(walkChunks[i].heads[j]));
+        }
+    }
+    walkEnd();
+
+    munmap(heads, room);
+    return 1;
+}
+
+// MYHEAP_STAT_USED_SIZE, _FREE_SIZE or _LARGEST_FREE of the current heap
+static long heapUsage(int stat) {
+    walkChunk total = { .end = heap->allocsize };
+
+    int count = walkSplit();
+    if (count == 1) {
+        walkBlocks(&total);
+    } else {
+        walkBegin(count);
+        walkHeap(walkBlocks, count);
+        for (int i = 0; i < count; i++) {
+            total.usedSize += walkChunks[i].usedSize;
+            total.freeSize += walkChunks[i].freeSize;
+            if (walkChunks[i].largestFree > total.largestFree) {
+                total.largestFree = walkChunks[i].largestFree;
+            }
+        }
+        walkEnd();
+    }
+
+    if (stat == MYHEAP_STAT_USED_SIZE) {
+        return total.usedSize;
+    }
+    return stat == MYHEAP_STAT_FREE_SIZE ? total.freeSize : total.largestFree;
+}
+
+/*
+ * Function for changing the coalesce budget of a live heap, see myHeap.h.
+ * Returns 0 on success.
+ * Returns -1 for any other option or an invalid value.
+ */
+int myHeapOpt(myHeap *h, int param, long value) {
+    if (h == NULL || param != MYHEAP_OPT_COALESCE_BUDGET ||
+        value < 0 || value > 0x7fffffff) {
+        return -1;
+    }
+    pthread_mutex_lock(&h->lock);
+    h->opt.coalesceBudget = value;
+    pthread_mutex_unlock(&h->lock);
+    return 0;
+}
+
+/*
+ * Function for setting allocator options, see myHeap.h.
+ * Options apply to the heaps created after the call, by myInit or
+ * myHeapCreate.  The coalesce budget also changes on the default heap.
+ * Not thread-safe, options should be set before threads create heaps.
+ * Returns 0 on success.
+ * Returns -1 for an unknown option or value.
+ */
+int myOpt(int param, long value) {
+    switch (param) {
+    case MYHEAP_OPT_COALESCE_BUDGET:
+        if (value < 0 || value > 0x7fffffff) {
+            return -1;
+        }
+        options.coalesceBudget = value;
+        return myHeapOpt(&defaultHeap, param, value);
+
+    case MYHEAP_OPT_TCACHE:
+        if (value < 0 || value > 0x7fffffff) {
+            return -1;
+        }
+        options.tcacheCount = value;
+        return 0;
+
+    case MYHEAP_OPT_ARENAS:
+        options.arenas = value != 0;
+        return 0;
+
+    case MYHEAP_OPT_CPUCACHE:
+        if (value < 0 || value > CPUCACHE_MAX) {
+            return -1;
+        }
+        options.cpuCacheCount = value;
+        return 0;
+
+    case MYHEAP_OPT_MAGAZINES:
+        if (value < 0 || value > MAGAZINE_MAX) {
+            return -1;
+        }
+        options.magazineSize = value;
+        return 0;
+
+    case MYHEAP_OPT_COMBINING:
+        options.combining = value != 0;
+        return 0;
+
+    case MYHEAP_OPT_LOCKFREE:
+        if (value < 0 || value > 0x7fffffff) {
+            return -1;
+        }
+        options.stackCount = value;
+        return 0;
+
+    case MYHEAP_OPT_SHARDS:
+        if (value < 0 || value > MAX_SHARDS) {
+            return -1;
+        }
+        options.shards = value;
+        return 0;
+
+    case MYHEAP_OPT_STEAL:
+        options.steal = value != 0;
+        return 0;
+
+    case MYHEAP_OPT_RECLAIM:
+        if (value < 0 || value > 0x7fffffff) {
+            return -1;
+        }
+        options.reclaimInterval = value;
+        return 0;
+
+    case MYHEAP_OPT_WALK_THREADS:
+        if (value < 0 || value > WALK_MAX_THREADS) {
+            return -1;
+        }
+        options.walkThreads = value;
+        return 0;
+
+    case MYHEAP_OPT_ISOLATE:
+        options.isolate = value != 0;
+        return 0;
+
+    case MYHEAP_OPT_ENGINE:
+        if (value != MYHEAP_ENGINE_BINS && value != MYHEAP_ENGINE_TREE &&
+            value != MYHEAP_ENGINE_TLSF) {
+            return -1;
+        }
+        options.engine = value;
+        return 0;
+
+    case MYHEAP_OPT_MAX_SIZE:
+        if (value < 0 || value > HSIZE_MAX) {
+            return -1;
+        }
+        options.maxSize = value;
+        return 0;
+
+    case MYHEAP_OPT_PURGE:
+        if (value != MYHEAP_PURGE_OFF && value != MYHEAP_PURGE_DONTNEED &&
+            value != MYHEAP_PURGE_FREE) {
+            return -1;
+        }
+        options.purgeMode = value;
+        return 0;
+
+    case MYHEAP_OPT_PURGE_DECAY:
+        if (value < 0 || value > 0x7fffffff) {
+            return -1;
+        }
+        options.purgeDecay = value;
+        return 0;
+
+    case MYHEAP_OPT_HUGEPAGES:
+        if (value != MYHEAP_HUGE_OFF && value != MYHEAP_HUGE_THP &&
+            value != MYHEAP_HUGE_HUGETLB) {
+            return -1;
+        }
+        options.hugeMode = value;
+        return 0;
+
+    case MYHEAP_OPT_RETRY:
+        options.retryOnFail = value != 0;
+        return 0;
+
+    case MYHEAP_OPT_COALESCE:
+        if (value != MYHEAP_COALESCE_DELAYED &&
+            value != MYHEAP_COALESCE_IMMEDIATE &&
+            value != MYHEAP_COALESCE_INCREMENTAL) {
+            return -1;
+        }
+        options.coalesceMode = value;
+        return 0;
+    }
+    return -1;
+}
+
+/*
+ * Function for reading allocator counters, see myHeap.h.
+ * Returns the counter's value, or -1 for an unknown counter.
+ */
+long myHeapStat(myHeap *h, int stat) {
+    if (h == NULL) {
+        return -1;
+    }
+    // kept per thread, not per heap
+    if (stat == MYHEAP_STAT_LAST_RETRY) {
+        return lastRetry;
+    }
+    long value = -1;
+
+    pthread_mutex_lock(&h->lock);
+    switch (stat) {
+    case MYHEAP_STAT_RETRIES:
+        value = h->retryCount;
+        break;
+    case MYHEAP_STAT_RETRY_HITS:
+        value = h->retryHits;
+        break;
+    case MYHEAP_STAT_HEAP_SIZE:
+        value = h->heapStart == NULL ? 0 : h->allocsize + 8;
+        break;
+    case MYHEAP_STAT_GROWS:
+        value = h->growCount;
+        break;
+    case MYHEAP_STAT_PURGED_PAGES:
+        value = h->purgedPages;
+        break;
+    case MYHEAP_STAT_REFAULTED_PAGES:
+        value = h->refaultedPages;
+        break;
+    case MYHEAP_STAT_HUGEPAGES:
+        value = h->hugeActive;
+        break;
+    case MYHEAP_STAT_PAGE_SIZE:
+        value = h->heapPage;
+        break;
+    case MYHEAP_STAT_STEALS:
+        value = h->steals;
+        break;
+    case MYHEAP_STAT_ISOLATE_MOVES:
+        value = h->isolateMoves;
+        break;
+    case MYHEAP_STAT_USED_SIZE:
+    case MYHEAP_STAT_FREE_SIZE:
+    case MYHEAP_STAT_LARGEST_FREE:
+        heap = h;
+        value = h->heapStart == NULL ? 0 : heapUsage(stat);
+        break;
+    }
+    pthread_mutex_unlock(&h->lock);
+    return value;
+}
+
+long myStat(int stat) {
+    if (stat == MYHEAP_STAT_ARENAS) {
+        return __atomic_load_n(&arenaCount, __ATOMIC_ACQUIRE);
+    }
+    if (stat == MYHEAP_STAT_CPUCACHE) {
+        return cpuCaches != NULL;
+    }
+    if (stat == MYHEAP_STAT_SHARDS) {
+        return shardCount;
+    }
+    if (stat == MYHEAP_STAT_MAGAZINE_SIZE) {
+        long largest = 0;
+        for (int index = 0; index < TCACHE_CLASSES; index++) {
+            if (depots[index].magazineSize > largest) {
+                largest = depots[index].magazineSize;
+            }
+        }
+        return largest;
+    }
+    return myHeapStat(arena != NULL ? arena : &defaultHeap, stat);
+}
+
+ 
+// the owner entry of the cache line holding addr
+static lineOwner* lineOf(void *addr) {
+    return &heap->lines[(addr - heapBase()) / ISOLATE_LINE];
+}
+
+// whether a payload of 'owner' may touch the cache line holding addr
+static int lineFree(void *addr, unsigned int owner) {
+    lineOwner *line = lineOf(addr);
+    return line->users == 0 || line->owner == owner;
+}
+
+// makes the lines an allocated block's payload touches the owner's
+static void lineClaim(blockHeader *block, unsigned int owner) {
+    void *last = (void*)block + blockSize(block) - 1;
+    for (lineOwner *line = lineOf((void*)block + sizeof(blockHeader)); line <= lineOf(last); line++) {
+        // read by tcacheFree without the lock
+        __atomic_store_n(&line->owner, owner, __ATOMIC_RELAXED);
+        line->users++;
+    }
+}
+
+static void lineRelease(blockHeader *block) {
+    void *last = (void*)block + blockSize(block) - 1;
+    for (lineOwner *line = lineOf((void*)block + sizeof(blockHeader)); line <= lineOf(last); line++) {
+        line->users--;
+    }
+}
+
+/*
+ * Where in a free block a block of 'size' bytes for 'owner' can go, at
+ * the start of the free block or with its payload at the next cache line
+ * that leaves room for a free block in front of it.
+ * Returns the offset in the free block, or -1 if neither works.
+ */
+static hsize isolatePlace(blockHeader *block, hsize size, unsigned int owner) {
+    hsize total = blockSize(block);
+    void *payload = (void*)block + sizeof(blockHeader);
+
+    // a payload starting at a line starts on a line of the free block
+    hsize offset = 0;
+    if (!lineFree(payload, owner)) {
+        offset = ISOLATE_LINE - (unsigned long)payload % ISOLATE_LINE;
+        if (offset < heap->minBlock) {
+            offset += ISOLATE_LINE;
+        }
+    }
+    if (offset + size > total) {
+        return -1;
+    }
+
+    // a leftover too small for a free block stays part of the block
+    hsize end = offset + size;
+    if (total - end < heap->minBlock) {
+        end = total;
+    }
+    if (!lineFree((void*)block + end - 1, owner)) {
+        return -1;
+    }
+    return offset;
+}
+
+/*
+ * heapAlloc with MYHEAP_OPT_ISOLATE for a block of 'size' bytes, already
+ * rounded and at least minBlock.  The block is cut out of a free block
+ * the way isolatePlace says, with free blocks left in front of and after
+ * it as needed.
+ */
+static void* isolateAlloc(hsize size) {
+    unsigned int owner = allocFor != 0 ? allocFor : tcache.id;
+
+    blockHeader *best = findBestFit(size);
+    hsize offset = best == NULL ? -1 : isolatePlace(best, size, owner);
+
+    //a larger block always has room for lines of its own
+    if (offset < 0) {
+        hsize room = size + 2 * (ISOLATE_LINE + heap->minBlock);
+        best = findBestFit(room);
+        if (best == NULL && heap->opt.retryOnFail) {
+            best = mergeForFit(room);
+        }
+        if (best == NULL && !allocNoGrow && heap->reservesize > heap->allocsize + 8) {
+            best = growHeap(room);
+        }
+        offset = best == NULL ? -1 : isolatePlace(best, size, owner);
+        if (offset < 0) {
+            return NULL;
+        }
+    }
+
+    hsize best_size = blockSize(best);
+    blockHeader *alloc = (void*)best + offset;
+    freeRemove(best);
+
+    //the part in front keeps the free block's header, p-bit and queue entry
+    if (offset > 0) {
+        best->size_status -= best_size - offset;
+        blockHeader *best_footer = (void*)alloc - sizeof(blockHeader);
+        best_footer->size_status = offset;
+        freeInsert(best);
+
+        alloc->size_status = 0;
+        setPrevAllocated(alloc, 0);
+        setBlockStart(alloc, 1);
+        heap->isolateMoves++;
+    }
+
+    //a leftover too small for a free block stays part of the block
+    hsize alloc_size = best_size - offset;
+    if (alloc_size - size >= heap->minBlock) {
+        blockHeader *new = (void*)alloc + size;
+        new->size_status = alloc_size - size;
+        setPrevAllocated(new, 1);
+        setBlockStart(new, 1);
+        blockHeader *new_footer = (void*)new + alloc_size - size - sizeof(blockHeader);
+        new_footer->size_status = alloc_size - size;
+        if (heap->opt.coalesceMode == MYHEAP_COALESCE_INCREMENTAL) {
+            new = mergeNeighbours(new);
+        }
+        freeInsert(new);
+        alloc_size = size;
+    } else {
+        blockHeader *next = (void*)alloc + alloc_size;
+        if (next->size_status != 1) {
+            setPrevAllocated(next, 1);
+        } else {
+            heap->lastAllocated = 1;
+        }
+    }
+
+    //a block at the start of the free block keeps its queue entry
+    alloc->size_status = alloc_size + 1;
+    lineClaim(alloc, owner);
+
+    if (heap->opt.purgeMode != MYHEAP_PURGE_OFF) {
+        countRefaults(alloc, alloc_size);
+    }
+    return (void*)alloc + sizeof(blockHeader);
+}
+
+/* 
+ * Function for allocating 'size' bytes of heap memory.
+ * Argument size: requested size for the payload
+ * Returns address of allocated block (payload) on success.
+ * Returns NULL on failure.
+ *
+ * This function must:
+ * - Check size - Return NULL if not positive or if larger than heap space.
+ * - Determine block size rounding up to a multiple of 8 
+ *   and possibly adding padding as a result.
+ *
+ * - Use BEST-FIT PLACEMENT POLICY to chose a free block
+ *   The free blocks are looked up in the size-class bins, so only bins
+ *   that can hold a block of the requested size are searched.
+ *
+ * - If the BEST-FIT block that is found is exact size match
+ *   - 1. Update all heap blocks as needed for any affected blocks
+ *   - 2. Return the address of the allocated block payload
+ *
+ * - If the BEST-FIT block that is found is large enough to split 
+ *   - 1. SPLIT the free block into two valid heap blocks:
+ *         1. an allocated block
+ *         2. a free block
+ *         NOTE: both blocks must meet heap block requirements 
+ *       - Update all heap block header(s) and footer(s) 
+ *              as needed for any affected blocks.
+ *   - 2. Return the address of the allocated block payload
+ *
+ * - If a BEST-FIT block found is NOT found, return NULL
+ *   Return NULL unable to find and allocate block for desired size
+ *   With MYHEAP_OPT_RETRY adjacent free blocks are merged first until
+ *   one is large enough, see mergeForFit.
+ *   With MYHEAP_OPT_MAX_SIZE the heap then grows, see growHeap.
+ *
+ * Note: payload address that is returned is NOT the address of the
+ *       block header.  It is the address of the start of the 
+ *       available memory for the requesterr.
+ *
+ * Tips: Be careful with pointer arithmetic and scale factors.
+ */
+static void* heapAlloc(myHeapSize request) {     
+
+    //an unsigned request too large for hsize turns negative here
+    hsize size = request;
+
+    //a growable heap can hold up to its reservation
+    if(size <= 0 || size > (heap->reservesize > heap->allocsize + 8 ? heap->reservesize - 8 : heap->allocsize)){
+	    return NULL;
+    }
+
+    //add the header to size
+    size += sizeof(blockHeader);
+
+    //checks if multiple of 8
+    if(size % 8 != 0){
+	    size = size + 8 - (size % 8);
+    }
+
+    //every block must be able to hold its free-list links once freed
+    if(size < heap->minBlock){
+	    size = heap->minBlock;
+    }
+
+    //with MYHEAP_OPT_ISOLATE the block may have to move off other threads' lines
+    if(heap->lines != NULL){
+	    return isolateAlloc(size);
+    }
+
+    //the free block index only holds free blocks, so allocated ones are never looked at
+    blockHeader *best = findBestFit(size);
+
+    //merges just enough free blocks to make one fit before giving up
+    if(best == NULL && heap->opt.retryOnFail){
+	    best = mergeForFit(size);
+    }
+
+    //grows the heap if it was reserved larger than it started
+    if(best == NULL && !allocNoGrow && heap->reservesize > heap->allocsize + 8){
+	    best = growHeap(size);
+    }
+
+    //if no eligible block was found we return NULL
+    if(best == NULL) return NULL;
+
+    hsize best_size = blockSize(best);
+
+    //the chosen block leaves the free lists whether it is split or not
+    freeRemove(best);
+
+    //the case for when the size is perfect for the data, or the leftover
+    //would be too small to hold a free block of its own
+    if(best_size - size < heap->minBlock){
+	// set a block to 1
+	best -> size_status += 1;
+
+	//jumps to next block space
+	blockHeader *new = (void*) best +  best_size;
+	
+	//as long as its not on the end bit 
+	if(new -> size_status != 1){
+		// set p block to 1
+		setPrevAllocated(new, 1);
+	} else {
+		heap->lastAllocated = 1;
+	}
+
+	//purged pages handed out again will be faulted back in
+	if(heap->opt.purgeMode != MYHEAP_PURGE_OFF){
+		countRefaults(best, best_size);
+	}
+
+	//returns the best ptr with the extra space for the header added on
+	return (void*) best + sizeof(blockHeader);
+    }
+
+    //with huge pages a large block comes off the end so the free part keeps the
+    //low addresses that small blocks are packed into
+    if(heap->hugeActive != MYHEAP_HUGE_OFF && size >= LARGE_LIMIT){
+	    blockHeader *alloc = (void*) best + best_size - size;
+
+	    //the free part keeps its header, p-bit and queue entry, only its size shrinks
+	    best -> size_status -= size;
+	    blockHeader *best_footer = (void*) alloc - sizeof(blockHeader);
+	    best_footer -> size_status = best_size - size;
+	    freeInsert(best);
+
+	    //allocated with a free block in front of it
+	    alloc -> size_status = size + 1;
+	    setBlockStart(alloc, 1);
+
+	    blockHeader *next = (void*) alloc + size;
+	    setPrevAllocated(alloc, 0);
+	    if(next -> size_status != 1){
+		    setPrevAllocated(next, 1);
+	    } else {
+		    heap->lastAllocated = 1;
+	    }
+
+	    if(heap->opt.purgeMode != MYHEAP_PURGE_OFF){
+		    countRefaults(alloc, size);
+	    }
+	    return (void*) alloc + sizeof(blockHeader);
+    }
+
+    //if the size is too big and can be split up into an allocated block and a free block
+	    blockHeader *new = (blockHeader*) ((void*) best + size); 
+
+	    //increments size_status to increment a bit, and to update the size in the footer 
+	    best -> size_status += size - best_size + 1;
+	    
+	    //size_status should be the a-bit + size-of-block
+	    //so this one, is unallocated, would have a value of
+	    //a + size = 0 + (best_size - size), and the previous is allocated
+	    new -> size_status = 0 + (best_size - size);
+	    setPrevAllocated(new, 1);
+	    setBlockStart(new, 1);
+
+	    //footer pointer, moves over to start of footer
+	    blockHeader *new_footer = (void*) new + best_size - size - sizeof(blockHeader);
+
+	    //footer holds only size of the memory space
+	    new_footer -> size_status = best_size - size;
+
+	    //purged pages handed out again will be faulted back in
+	    if(heap->opt.purgeMode != MYHEAP_PURGE_OFF){
+		    countRefaults(best, size);
+	    }
+
+	    //a queued block may have been split, the leftover then takes over
+	    //merging with a free block after it since it is not queued itself
+	    if(heap->opt.coalesceMode == MYHEAP_COALESCE_INCREMENTAL){
+		    new = mergeNeighbours(new);
+	    }
+
+	    //the leftover goes back into the free block index
+	    freeInsert(new);
+	   
+	    //returns address of the payload
+	    return (void*) best + sizeof(blockHeader);
+} 
+ 
+/* 
+ * Function for freeing up a previously allocated block.
+ * Argument ptr: address of the block to be freed up.
+ * Returns 0 on success.
+ * Returns -1 on failure.
+ * This function should:
+ * - Return -1 if ptr is NULL.
+ * - Return -1 if ptr is not a multiple of 8.
+ * - Return -1 if ptr is outside of the heap space, e.g. from another heap.
+ * - Return -1 if ptr block is already freed.
+ * - Update header(s) and footer as needed.
+ * - With MYHEAP_COALESCE_IMMEDIATE (and always with the TLSF engine)
+ *   merge the block with free neighbours before indexing it.
+ * - With MYHEAP_COALESCE_INCREMENTAL record the block in the dirty queue.
+ * - With MYHEAP_OPT_PURGE purge free pages that have decayed.
+ */                   
+static int heapFree(void *ptr) {    
+     //return -1 if ptr is NULL
+    if(ptr == NULL){
+            return -1;
+    }
+
+    //return -1 if ptr is not a multiple of 8
+    if((unsigned long)ptr % 8 != 0){
+            return -1;
+    }
+
+    
+    //return -1 if ptr is outside of the heap space
+    if(ptr < (void*)heap->heapStart || ptr > (void*)heap->heapStart + heap->allocsize){
+	    return -1;
+    }
+
+    //header variable
+    blockHeader *header = ptr - sizeof(blockHeader);
+
+    //checks if there is an A-Bit or not, if it is already freed, return -1
+    if(header -> size_status % 2 == 0){
+		return -1;
+    }
+
+    //the lines of the payload lose a user
+    if(heap->lines != NULL){
+	    lineRelease(header);
+    }
+
+    //takes out a bit 
+    header -> size_status -= 1;
+
+    //this jumps to next block so we can change its p-bit
+    hsize block_size = header -> size_status - header -> size_status % 8;
+
+    //new pointer that goes to the header of the next one
+    blockHeader *new = (void*)header + block_size;
+
+    //as long as its not at the end bit 
+    if(new -> size_status != 1){
+
+	    //clears the p-bit in the map, the next block itself is not touched
+	    setPrevAllocated(new, 0);
+    } else {
+	    heap->lastAllocated = 0;
+    }
+
+    //this is the footer pointer
+    blockHeader *footer = (void*)header + block_size - sizeof(blockHeader); 
+    
+    // changes the size of the footer 
+    footer -> size_status = block_size;
+
+    //merges right away so that no free block ever needs a heap walk
+    if(mergesOnFree()){
+	    header = mergeNeighbours(header);
+    }
+
+    //makes the block findable by myAlloc again
+    freeInsert(header);
+
+    //records the block for the next coalesce(), unless it still has an entry
+    //or was merged above, which the TLSF engine always does
+    if(heap->opt.coalesceMode == MYHEAP_COALESCE_INCREMENTAL && !mergesOnFree() &&
+       !isQueued(header)){
+	    dirtyPush(header);
+    }
+
+    //gives pages that stayed free long enough back to the OS
+    if(!heap->reclaimed){
+	    maybePurge();
+    }
+
+    //returns 0 because successful
+    return 0;
+} 
+
+
+/*
+ * Function for traversing the free lists and coalescing all adjacent 
+ * free blocks.
+ *
+ * This function is used for delayed coalescing, with immediate coalescing
+ * there is nothing left to merge and it returns right away.  With
+ * incremental coalescing only the dirty queue is processed, at most
+ * MYHEAP_OPT_COALESCE_BUDGET entries per call.
+ * Only free blocks are visited: every run of adjacent free blocks starts
+ * with a block whose p-bit is set, and that block absorbs the rest of the
+ * run.  Free blocks whose previous block is free are skipped, they get
+ * absorbed when their run is handled.
+ * Updated header size_status and footer size_status as needed.
+ */
+static int heapCoalesce() {
+
+	//gives pages that stayed free long enough back to the OS
+	maybePurge();
+
+	//when myFree merges there are never two adjacent free blocks
+	if(mergesOnFree()){
+		return 1;
+	}
+
+	//only the blocks freed since the last call can have free neighbours
+	if(heap->opt.coalesceMode == MYHEAP_COALESCE_INCREMENTAL){
+		int work = 0;
+		while(heap->dirtyCount > 0 && (heap->opt.coalesceBudget == 0 || work < heap->opt.coalesceBudget)){
+			dirtyProcess();
+			work++;
+		}
+		return 1;
+	}
+
+	//a heap split into chunks gets its run heads from the walkers
+	int count = walkSplit();
+	if(count > 1 && walkCoalesce(count)){
+		return 1;
+	}
+
+	//the tree cannot be changed while it is walked, so the run heads are
+	//collected first.  They are never absorbed since their previous block is allocated.
+	hsize head = treeCollectRuns(heap->treeRoot, NO_BLOCK);
+	while(head != NO_BLOCK){
+		hsize run = nodeOf(head) -> run;
+		mergeRun(blockAt(head));
+		head = run;
+	}
+
+	//walks every non-empty bin of the bins engine, the merged blocks can
+	//only move to later bins or to the tree
+	for(int index = nextBin(0); index != -1; index = nextBin(index + 1)){
+
+		hsize offset = heap->bins[index];
+		while(offset != NO_BLOCK){
+
+			blockHeader *ptr = blockAt(offset);
+
+			//remembers the next free block before the lists change
+			offset = linksOf(ptr) -> next;
+
+			if(!isRunHead(ptr)){
+				continue;
+			}
+
+			//skips the free blocks of this bin that are about to be absorbed
+			blockHeader *end = runEnd(ptr);
+			while(offset != NO_BLOCK && blockAt(offset) > ptr && blockAt(offset) < end){
+				offset = linksOf(blockAt(offset)) -> next;
+			}
+
+			mergeRun(ptr);
+		}
+	}
+
+	return 1;
+}
+
+
+ 
+/*
+ * Reserves 'size' bytes of address space backed by huge pages, trying the
+ * hugetlb pool first if asked for and transparent huge pages after that.
+ * Sets hugeActive to what it got.  Returns MAP_FAILED if neither worked.
+ */
+static void* reserveHuge(long size) {
+    void *ptr;
+
+    // without MAP_NORESERVE the pool pages are claimed now, so a pool that
+    // is too small fails here instead of with SIGBUS on first touch
+    if (heap->opt.hugeMode == MYHEAP_HUGE_HUGETLB) {
+        ptr = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (MAP_FAILED != ptr) {
+            heap->hugeActive = MYHEAP_HUGE_HUGETLB;
+            return ptr;
+        }
+    }
+
+    // over-reserves by one huge page and trims both ends to align the heap
+    void *raw = mmap(NULL, size + HUGE_PAGE, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (MAP_FAILED == raw) {
+        return MAP_FAILED;
+    }
+    ptr = (void*)(((unsigned long)raw + HUGE_PAGE - 1) & ~((unsigned long)HUGE_PAGE - 1));
+    if (ptr > raw) {
+        munmap(raw, ptr - raw);
+    }
+    munmap(ptr + size, raw + size + HUGE_PAGE - (ptr + size));
+
+    if (madvise(ptr, size, MADV_HUGEPAGE) != 0) {
+        munmap(ptr, size);
+        return MAP_FAILED;
+    }
+    heap->hugeActive = MYHEAP_HUGE_THP;
+    return ptr;
+}
+
+#ifdef CPUCACHE_RSEQ
+// the calling thread's rseq area, registered by libc
+static struct rseq* rseqArea() {
+    return (struct rseq*)((char*)__builtin_thread_pointer() + __rseq_offset);
+}
+
+/*
+ * Pushes a block address onto the calling CPU's stack for a block size.
+ * Returns 0 if it was pushed, or 1 if the stack holds 'limit' blocks, the
+ * CPU has no cache or its cache is being emptied.
+ */
+static int cpuPush(int index, void *ptr, long limit) {
+    struct rseq *rs = rseqArea();
+restart:;
+    int cpu = __atomic_load_n(&rs->cpu_id_start, __ATOMIC_RELAXED);
+    if (cpu >= cpuCount) {
+        return 1;
+    }
+    cpuCache *cache = &cpuCaches[cpu];
+
+    // 1: start, 2: end of the sequence after the committing store,
+    // 4: abort handler, preceded by the signature the kernel checks
+    __asm__ __volatile__ goto (
+        ".pushsection __rseq_cs, \"aw\"\n\t"
+        ".balign 32\n\t"
+        "3:\n\t"
+        ".long 0x0, 0x0\n\t"
+        ".quad 1f, (2f - 1f), 4f\n\t"
+        ".popsection\n\t"
+        "leaq 3b(%%rip), %%rax\n\t"
+        "movq %%rax, %[rseq_cs]\n\t"
+        "1:\n\t"
+        "cmpl %[cpu], %[cpu_id]\n\t"
+        "jnz %l[restart]\n\t"
+        "cmpl $0, %[draining]\n\t"
+        "jnz %l[full]\n\t"
+        "movq %[count], %%rax\n\t"
+        "cmpq %[limit], %%rax\n\t"
+        "jae %l[full]\n\t"
+        "movq %[ptr], (%[slots], %%rax, 8)\n\t"
+        "incq %%rax\n\t"
+        "movq %%rax, %[count]\n\t"
+        "2:\n\t"
+        ".pushsection __rseq_failure, \"ax\"\n\t"
+        ".byte 0x0f, 0xb9, 0x3d\n\t"
+        ".long 0x53053053\n\t"
+        "4:\n\t"
+        "jmp %l[restart]\n\t"
+        ".popsection\n\t"
+        :
+        : [rseq_cs] "m" (rs->rseq_cs), [cpu_id] "m" (rs->cpu_id), [cpu] "r" (cpu),
+          [draining] "m" (cache->draining),
+          [count] "m" (cache->counts[index]), [slots] "r" (cache->slots[index]),
+          [limit] "r" (limit), [ptr] "r" (ptr)
+        : "memory", "cc", "rax"
+        : restart, full);
+    return 0;
+full:
+    return 1;
+}
+
+/*
+ * Pops a block address off the calling CPU's stack for a block size into
+ * *ptr.  Returns 0 if it got one, or 1 if the stack is empty, the CPU has
+ * no cache or its cache is being emptied.
+ */
+static int cpuPop(int index, void **ptr) {
+    struct rseq *rs = rseqArea();
+restart:;
+    int cpu = __atomic_load_n(&rs->cpu_id_start, __ATOMIC_RELAXED);
+    if (cpu >= cpuCount) {
+        return 1;
+    }
+    cpuCache *cache = &cpuCaches[cpu];
+
+    __asm__ __volatile__ goto (
+        ".pushsection __rseq_cs, \"aw\"\n\t"
+        ".balign 32\n\t"
+        "3:\n\t"
+        ".long 0x0, 0x0\n\t"
+        ".quad 1f, (2f - 1f), 4f\n\t"
+        ".popsection\n\t"
+        "leaq 3b(%%rip), %%rax\n\t"
+        "movq %%rax, %[rseq_cs]\n\t"
+        "1:\n\t"
+        "cmpl %[cpu], %[cpu_id]\n\t"
+        "jnz %l[restart]\n\t"
+        "cmpl $0, %[draining]\n\t"
+        "jnz %l[empty]\n\t"
+        "movq %[count], %%rax\n\t"
+        "testq %%rax, %%rax\n\t"
+        "jz %l[empty]\n\t"
+        "decq %%rax\n\t"
+        "movq (%[slots], %%rax, 8), %%rcx\n\t"
+        "movq %%rcx, (%[ptr])\n\t"
+        "movq %%rax, %[count]\n\t"
+        "2:\n\t"
+        ".pushsection __rseq_failure, \"ax\"\n\t"
+        ".byte 0x0f, 0xb9, 0x3d\n\t"
+        ".long 0x53053053\n\t"
+        "4:\n\t"
+        "jmp %l[restart]\n\t"
+        ".popsection\n\t"
+        :
+        : [rseq_cs] "m" (rs->rseq_cs), [cpu_id] "m" (rs->cpu_id), [cpu] "r" (cpu),
+          [draining] "m" (cache->draining),
+          [count] "m" (cache->counts[index]), [slots] "r" (cache->slots[index]),
+          [ptr] "r" (ptr)
+        : "memory", "cc", "rax", "rcx"
+        : restart, empty);
+    return 0;
+empty:
+    return 1;
+}
+
+/*
+ * Restarts every restartable sequence running on 'cpu' at the time of the
+ * call, or on every CPU when 'cpu' is -1 to register the process for it.
+ * Returns 0 on success.
+ */
+static int cpuFence(int cpu) {
+    if (cpu < 0) {
+        return syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_RSEQ, 0, 0);
+    }
+    return syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ,
+                   MEMBARRIER_CMD_FLAG_CPU, cpu);
+}
+#else
+// never called, cpuCaches stays NULL without rseq
+static int cpuFence(int cpu) {
+    (void)cpu;
+    return -1;
+}
+
+static int cpuPush(int index, void *ptr, long limit) {
+    (void)index, (void)ptr, (void)limit;
+    return 1;
+}
+
+static int cpuPop(int index, void **ptr) {
+    (void)index, (void)ptr;
+    return 1;
+}
+#endif
+
+/*
+ * Maps the heap space of a zeroed myHeap and sets it up with the given
+ * options, see myInit.
+ * Returns 0 on success.
+ * Returns -1 on failure, leaving the heap's heapStart NULL.
+ */
+static int heapInit(myHeap *h, const heapOptions *opt, myHeapSize request) {
+
+    hsize pagesize; // page size
+    hsize padsize;  // size of padding when heap size not a multiple of page size
+    hsize sizeOfRegion = request; // negative if an unsigned request is too large
+    void* mmap_ptr; // pointer to memory mapped area
+    int fd;
+
+    blockHeader* endMark;
+
+    heap = h;
+    heap->opt = *opt;
+    heap->minBlock = heap->opt.engine == MYHEAP_ENGINE_TREE ? TREE_MIN_BLOCK : MIN_BLOCK;
+
+    if (sizeOfRegion <= 0) {
+        fprintf(stderr, "Error:mem.c: Requested block size is not positive\n");
+        return -1;
+    }
+    // room is left for rounding up to a whole huge page
+    if (sizeOfRegion > HSIZE_MAX - HUGE_PAGE) {
+        fprintf(stderr, "Error:mem.c: Requested block size is too large for the heap\n");
+        return -1;
+    }
+
+    // Get the pagesize, huge pages size the heap in 2 MiB steps
+    pagesize = heap->opt.hugeMode == MYHEAP_HUGE_OFF ? getpagesize() : HUGE_PAGE;
+
+    // Calculate padsize as the padding required to round up sizeOfRegion 
+    // to a multiple of pagesize
+    padsize = sizeOfRegion % pagesize;
+    padsize = (pagesize - padsize) % pagesize;
+
+    heap->allocsize = sizeOfRegion + padsize;
+
+    // The reservation for a growable heap, whole pages and at least allocsize
+    heap->reservesize = heap->opt.maxSize / pagesize * pagesize;
+    if (heap->reservesize < heap->allocsize) {
+        heap->reservesize = heap->allocsize;
+    }
+
+    // Using mmap to reserve the address space, only allocsize is accessible
+    heap->hugeActive = MYHEAP_HUGE_OFF;
+    mmap_ptr = MAP_FAILED;
+    if (heap->opt.hugeMode != MYHEAP_HUGE_OFF) {
+        mmap_ptr = reserveHuge(heap->reservesize);
+    }
+    if (MAP_FAILED == mmap_ptr) {
+        // normal pages, keeping the sizes rounded to huge pages if asked for
+        fd = open("/dev/zero", O_RDWR);
+        if (-1 == fd) {
+            fprintf(stderr, "Error:mem.c: Cannot open /dev/zero\n");
+            return -1;
+        }
+        mmap_ptr = mmap(NULL, heap->reservesize, PROT_NONE, MAP_PRIVATE | MAP_NORESERVE, fd, 0);
+        close(fd);
+        pagesize = getpagesize();
+    }
+    heap->heapPage = pagesize;
+    if (MAP_FAILED == mmap_ptr) {
+        fprintf(stderr, "Error:mem.c: mmap cannot allocate space\n");
+        return -1;
+    }
+    if (mprotect(mmap_ptr, heap->allocsize, PROT_READ | PROT_WRITE) != 0) {
+        fprintf(stderr, "Error:mem.c: mprotect cannot allocate space\n");
+        munmap(mmap_ptr, heap->reservesize);
+        return -1;
+    }
+
+    // A bit per 8 bytes of the reservation for the p-bits
+    heap->prevMap = mmap(NULL, heap->reservesize / 64 + 1, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (MAP_FAILED == heap->prevMap) {
+        fprintf(stderr, "Error:mem.c: mmap cannot allocate space\n");
+        munmap(mmap_ptr, heap->reservesize);
+        return -1;
+    }
+
+    // A bit per page of the reservation to track purged pages
+    if (heap->opt.purgeMode != MYHEAP_PURGE_OFF) {
+        heap->purgedMap = mmap(NULL, heap->reservesize / pagesize / 8 + 1, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == heap->purgedMap) {
+            fprintf(stderr, "Error:mem.c: mmap cannot allocate space\n");
+            munmap(heap->prevMap, heap->reservesize / 64 + 1);
+            munmap(mmap_ptr, heap->reservesize);
+            return -1;
+        }
+    }
+
+    // An owner per cache line of the reservation
+    heap->lines = NULL;
+    if (heap->opt.isolate) {
+        heap->lines = mmap(NULL, (heap->reservesize / ISOLATE_LINE + 1) * sizeof(lineOwner),
+                           PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (MAP_FAILED == heap->lines) {
+            fprintf(stderr, "Error:mem.c: mmap cannot allocate space\n");
+            if (heap->purgedMap != NULL) {
+                munmap(heap->purgedMap, heap->reservesize / pagesize / 8 + 1);
+            }
+            munmap(heap->prevMap, heap->reservesize / 64 + 1);
+            munmap(mmap_ptr, heap->reservesize);
+            return -1;
+        }
+    }
+
+    // A bit per 8 bytes of the reservation for the dirty queue entries,
+    // a heap that cannot have it merges its blocks in coalesce() alone
+    heap->queuedMap = NULL;
+    if (heap->opt.coalesceMode == MYHEAP_COALESCE_INCREMENTAL) {
+        heap->queuedMap = mmap(NULL, heap->reservesize / 64 + 1, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (MAP_FAILED == heap->queuedMap) {
+            heap->queuedMap = NULL;
+            heap->opt.coalesceMode = MYHEAP_COALESCE_DELAYED;
+        }
+    }
+
+    // A bit per 8 bytes of the reservation for the block starts, a heap
+    // that cannot have it is walked by one thread and reclaimed in one go
+    heap->startMap = NULL;
+    if (heap->opt.walkThreads > 1 || (heap->opt.reclaimInterval > 0 && !heap->opt.arenas)) {
+        heap->startMap = mmap(NULL, heap->reservesize / 64 + 1, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (MAP_FAILED == heap->startMap) {
+            heap->startMap = NULL;
+        }
+    }
+
+    // for double word alignment and end mark
+    heap->allocsize -= 8;
+
+    // Initially there is only one big free block in the heap.
+    // Skip first 4 bytes for double word alignment requirement,
+    // 8-byte headers need no padding.
+    heap->heapStart = (blockHeader*) ((void*)mmap_ptr + 8 - sizeof(blockHeader));
+
+    // Set the end mark
+    endMark = (blockHeader*)((void*)heap->heapStart + heap->allocsize);
+    endMark->size_status = 1;
+
+    // Set size in header
+    heap->heapStart->size_status = heap->allocsize;
+
+    // Set p-bit as allocated in the map
+    // note a-bit left at 0 for free
+    setPrevAllocated(heap->heapStart, 1);
+    setBlockStart(heap->heapStart, 1);
+
+    // Set the footer
+    blockHeader *footer = (blockHeader*) ((void*)heap->heapStart + heap->allocsize - sizeof(blockHeader));
+    footer->size_status = heap->allocsize;
+
+    // Start with an empty index and put the one big free block into it
+    for (int i = 0; i < NUM_BINS; i++) {
+        heap->bins[i] = NO_BLOCK;
+    }
+    memset(heap->binmap, 0, sizeof(heap->binmap));
+    heap->treeRoot = NO_BLOCK;
+    for (int fl = 0; fl < TLSF_FL_COUNT; fl++) {
+        for (int sl = 0; sl < TLSF_SL_COUNT; sl++) {
+            heap->tlsfLists[fl][sl] = NO_BLOCK;
+        }
+        heap->tlsfSlMap[fl] = 0;
+    }
+    heap->tlsfFlMap = 0;
+    heap->dirtyHead = 0;
+    heap->dirtyCount = 0;
+    heap->retryCount = 0;
+    heap->retryHits = 0;
+    heap->growCount = 0;
+    heap->lastAllocated = 0;
+    heap->purgedPages = 0;
+    heap->refaultedPages = 0;
+    heap->lastPurge = nowMs();
+    heap->reclaimed = 0;
+    heap->reclaimCursor = 0;
+    heap->remoteFrees = NO_BLOCK;
+    heap->steals = 0;
+    heap->pending = 0;
+    heap->isolateMoves = 0;
+    freeInsert(heap->heapStart);
+  
+    return 0;
+} 
+
+/*
+ * With MYHEAP_OPT_RECLAIM myInit starts a reclaimer thread that wakes up
+ * every reclaimInterval milliseconds and coalesces and purges the default
+ * heap and its shards, so that the threads calling myAlloc and myFree do
+ * not have to.  myFree then leaves purging to it.  The reclaimer only
+ * takes a heap's lock when it is free and gives it back after every
+ * RECLAIM_SLICE merges of the dirty queue, or with delayed coalescing
+ * after every RECLAIM_RANGE bytes of the heap, whose runs of free blocks
+ * it finds through startMap.  So a busy heap is skipped until the next
+ * round and neither a long queue nor a large heap holds up myAlloc for
+ * long.  Arenas are left alone, only their owners touch them.
+ */
+#define RECLAIM_SLICE 64
+#define RECLAIM_RANGE (64 * 1024)
+
+// merges the runs of free blocks whose first block starts in [begin, end)
+static void reclaimRange(hsize begin, hsize end) {
+    hsize offset = chunkFirst(begin, end);
+    while (offset < end) {
+        blockHeader *ptr = blockAt(offset);
+        if ((ptr->size_status & 1) == 0 && isRunHead(ptr)) {
+            mergeRun(ptr);
+        }
+        offset += blockSize(ptr);
+    }
+}
+
+// one round of the reclaimer over a heap
+static void reclaimHeap(myHeap *h) {
+    int more = 1;
+    while (more) {
+        if (pthread_mutex_trylock(&h->lock) != 0) {
+            return;
+        }
+        heap = h;
+        more = 0;
+        if (h->opt.coalesceMode == MYHEAP_COALESCE_INCREMENTAL && !mergesOnFree()) {
+            maybePurge();
+            for (int i = 0; i < RECLAIM_SLICE && h->dirtyCount > 0; i++) {
+                dirtyProcess();
+            }
+            more = h->dirtyCount > 0;
+        } else if (!mergesOnFree() && h->startMap != NULL) {
+            maybePurge();
+            // a busy heap is picked up where the last round left it, which
+            // may be past its end if it shrank since
+            hsize begin = h->reclaimCursor < h->allocsize ? h->reclaimCursor : 0;
+            hsize end = begin + RECLAIM_RANGE < h->allocsize ? begin + RECLAIM_RANGE : h->allocsize;
+            reclaimRange(begin, end);
+            h->reclaimCursor = end < h->allocsize ? end : 0;
+            more = h->reclaimCursor != 0;
+        } else {
+            heapCoalesce();
+        }
+        pthread_mutex_unlock(&h->lock);
+    }
+}
+
+static void* reclaimLoop(void *unused) {
+    (void)unused;
+    int interval = defaultHeap.opt.reclaimInterval;
+    struct timespec pause = { interval / 1000, interval % 1000 * 1000000L };
+
+    for (;;) {
+        nanosleep(&pause, NULL);
+        reclaimHeap(&defaultHeap);
+        for (int i = 1; i < shardCount; i++) {
+            reclaimHeap(shards[i]);
+        }
+    }
+    return NULL;
+}
+
+/* 
+ * Function used to initialize the memory allocator.
+ * Intended to be called ONLY once by a program, it sets up the default
+ * heap used by myAlloc, myFree, coalesce and dispMem.
+ * Argument sizeOfRegion: the size of the heap space to be allocated.
+ * With MYHEAP_OPT_MAX_SIZE the heap can later grow up to that size.
+ * Returns 0 on success.
+ * Returns -1 on failure.
+ */                    
+int myInit(myHeapSize sizeOfRegion) {    
+
+    pthread_mutex_lock(&defaultHeap.lock);
+
+    //prevent multiple myInit calls
+    if (defaultHeap.heapStart != NULL) {
+        pthread_mutex_unlock(&defaultHeap.lock);
+        fprintf(stderr, 
+        "Error:mem.c: InitHeap has allocated space during a previous call\n");
+        return -1;
+    }
+    // every shard gets an equal part of the region and of its growth
+    heapOptions opt = options;
+    // front ends that pass blocks between threads would share their lines
+    if (opt.isolate) {
+        opt.cpuCacheCount = 0;
+        opt.magazineSize = 0;
+        opt.stackCount = 0;
+    }
+    myHeapSize shardSize = sizeOfRegion;
+    if (opt.shards > 1 && !opt.arenas) {
+        shardSize = sizeOfRegion / opt.shards;
+        opt.maxSize /= opt.shards;
+        // the front ends only ever serve the default heap, the first shard
+        opt.tcacheCount = 0;
+        opt.cpuCacheCount = 0;
+        opt.magazineSize = 0;
+        opt.stackCount = 0;
+        opt.combining = 0;
+    }
+    int result = heapInit(&defaultHeap, &opt, shardSize);
+
+    if (result == 0 && opt.shards > 1 && !opt.arenas) {
+        shards[0] = &defaultHeap;
+        shardCount = 1;
+        while (shardCount < opt.shards) {
+            myHeap *h = mmap(NULL, sizeof(myHeap), PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (MAP_FAILED == h) {
+                break;
+            }
+            if (heapInit(h, &opt, shardSize) != 0) {
+                munmap(h, sizeof(myHeap));
+                break;
+            }
+            pthread_mutex_init(&h->lock, NULL);
+            shards[shardCount++] = h;
+        }
+        heap = &defaultHeap;
+    }
+
+    if (result == 0 && defaultHeap.opt.reclaimInterval > 0 && !defaultHeap.opt.arenas) {
+        pthread_t reclaimer;
+        if (pthread_create(&reclaimer, NULL, reclaimLoop, NULL) == 0) {
+            pthread_detach(reclaimer);
+            for (int i = 0; i < shardCount; i++) {
+                shards[i]->reclaimed = 1;
+            }
+            defaultHeap.reclaimed = 1;
+        }
+    }
+
+    // the default heap is the first arena, up for grabs by any thread
+    if (result == 0 && defaultHeap.opt.arenas) {
+        arenaSize = sizeOfRegion;
+        arenas[0] = &defaultHeap;
+        __atomic_store_n(&arenaCount, 1, __ATOMIC_RELEASE);
+    }
+
+    if (result == 0) {
+        for (int index = 0; index < TCACHE_CLASSES; index++) {
+            depots[index].magazineSize = defaultHeap.opt.magazineSize;
+        }
+    }
+
+    // the mark of cached blocks, different in every process
+    if (result == 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        cacheKey = (now.tv_nsec ^ getpid() * 2654435761u) | 0x80000000u;
+    }
+
+    // per-CPU caches where rseq works, the per-thread cache elsewhere
+    if (result == 0 && defaultHeap.opt.cpuCacheCount > 0) {
+        cpuCaches = NULL;
+#ifdef CPUCACHE_RSEQ
+        if (__rseq_size > 0 && (int)rseqArea()->cpu_id >= 0 && cpuFence(-1) == 0) {
+            cpuCount = sysconf(_SC_NPROCESSORS_CONF);
+            cpuCaches = mmap(NULL, cpuCount * sizeof(cpuCache), PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (MAP_FAILED == cpuCaches) {
+                cpuCaches = NULL;
+            }
+        }
+#endif
+        if (cpuCaches == NULL) {
+            defaultHeap.opt.tcacheCount = defaultHeap.opt.cpuCacheCount;
+        }
+    }
+
+    pthread_mutex_unlock(&defaultHeap.lock);
+    return result;
+}
+
+/*
+ * Function for creating a heap of its own, independent of the default heap
+ * and of every other heap.  It is set up like myInit does with the options
+ * set with myOpt() at the time of the call.
+ * Returns the new heap on success.
+ * Returns NULL on failure.
+ */
+myHeap* myHeapCreate(myHeapSize sizeOfRegion) {
+    myHeap *h = mmap(NULL, sizeof(myHeap), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == h) {
+        fprintf(stderr, "Error:mem.c: mmap cannot allocate space\n");
+        return NULL;
+    }
+    if (heapInit(h, &options, sizeOfRegion) != 0) {
+        munmap(h, sizeof(myHeap));
+        return NULL;
+    }
+    pthread_mutex_init(&h->lock, NULL);
+    return h;
+}
+
+/*
+ * Function for destroying a heap made by myHeapCreate.  All of its memory
+ * goes back to the OS, including blocks that are still allocated.  No
+ * other thread may use the heap any more.
+ * Returns 0 on success.
+ * Returns -1 if the heap is NULL or the default heap.
+ */
+int myHeapDestroy(myHeap *h) {
+    if (h == NULL || h == &defaultHeap) {
+        return -1;
+    }
+    heap = h;
+
+    munmap(heapBase(), heap->reservesize);
+    munmap(heap->prevMap, heap->reservesize / 64 + 1);
+    if (heap->queuedMap != NULL) {
+        munmap(heap->queuedMap, heap->reservesize / 64 + 1);
+    }
+    if (heap->startMap != NULL) {
+        munmap(heap->startMap, heap->reservesize / 64 + 1);
+    }
+    if (heap->lines != NULL) {
+        munmap(heap->lines, (heap->reservesize / ISOLATE_LINE + 1) * sizeof(lineOwner));
+    }
+    if (heap->purgedMap != NULL) {
+        munmap(heap->purgedMap, heap->reservesize / heap->heapPage / 8 + 1);
+    }
+    pthread_mutex_destroy(&h->lock);
+    munmap(h, sizeof(myHeap));
+
+    heap = &defaultHeap;
+    return 0;
+}
+
+static tcacheEntry* entryOf(blockHeader *block) {
+    return (tcacheEntry*)linksOf(block);
+}
+
+// a block handed out by a cache, which loses the mark of cacheKey
+static void* cacheTake(void *ptr) {
+    entryOf(ptr - sizeof(blockHeader))->key = 0;
+    return ptr;
+}
+
+// block size a request gets, or 0 if it is not positive
+static hsize tcacheSize(myHeapSize request) {
+    hsize size = request;
+    if (size <= 0 || size > HSIZE_MAX - 8) {
+        return 0;
+    }
+    size = (size + sizeof(blockHeader) + 7) / 8 * 8;
+    return size < defaultHeap.minBlock ? defaultHeap.minBlock : size;
+}
+
+// takes the first 'count' blocks of a list back to the heap, lock held
+static void tcacheFlush(int index, int count) {
+    while (count-- > 0 && tcache.lists[index] != NO_BLOCK) {
+        blockHeader *block = blockAt(tcache.lists[index]);
+        tcache.lists[index] = entryOf(block)->next;
+        tcache.counts[index]--;
+        heapFree((void*)block + sizeof(blockHeader));
+    }
+}
+
+static void tcacheFlushAll() {
+    for (int index = 0; index < TCACHE_CLASSES; index++) {
+        tcacheFlush(index, tcache.counts[index]);
+    }
+}
+
+static void tcachePush(int index, blockHeader *block) {
+    entryOf(block)->next = tcache.lists[index];
+    entryOf(block)->key = tcache.id;
+    tcache.lists[index] = offsetOf(block);
+    tcache.counts[index]++;
+}
+
+/*
+ * myAlloc for a block of 'size' bytes that fits the cache.  An empty list
+ * is refilled with up to half of opt.tcacheCount blocks, blocks that come
+ * out of the heap larger than asked for go into their own list.
+ */
+static void* tcacheAlloc(hsize size) {
+    int index = size / 8;
+
+    // the lists hold offsets into the default heap, whichever heap the
+    // thread used last
+    heap = &defaultHeap;
+
+    if (tcache.lists[index] == NO_BLOCK) {
+        int batch = (defaultHeap.opt.tcacheCount + 1) / 2;
+
+        pthread_mutex_lock(&defaultHeap.lock);
+        heap = &defaultHeap;
+        void *ptr = heapAlloc(size - sizeof(blockHeader));
+        if (ptr == NULL) {
+            // the blocks this thread holds on to may be what is missing
+            tcacheFlushAll();
+            ptr = heapAlloc(size - sizeof(blockHeader));
+        }
+        // the first block is handed out, the rest of the batch is cached
+        for (int i = 1; ptr != NULL && i < batch; i++) {
+            void *extra = heapAlloc(size - sizeof(blockHeader));
+            if (extra == NULL) {
+                break;
+            }
+            blockHeader *block = extra - sizeof(blockHeader);
+            int own = blockSize(block) / 8;
+            if (own < TCACHE_CLASSES && tcache.counts[own] < defaultHeap.opt.tcacheCount) {
+                tcachePush(own, block);
+            } else {
+                heapFree(extra);
+            }
+        }
+        pthread_mutex_unlock(&defaultHeap.lock);
+        return ptr;
+    }
+
+    blockHeader *block = blockAt(tcache.lists[index]);
+    tcache.lists[index] = entryOf(block)->next;
+    tcache.counts[index]--;
+    entryOf(block)->key = 0;
+    return (void*)block + sizeof(blockHeader);
+}
+
+/*
+ * myFree through the cache.  Does the checks myFree does without the lock
+ * and caches the block if its size fits.
+ * Returns 0 if the block was cached, -1 for an invalid pointer, or 1 if
+ * the block has to go to the heap.
+ */
+static int tcacheFree(void *ptr) {
+    blockHeader *start = defaultHeap.heapStart;
+    hsize allocsize = __atomic_load_n(&defaultHeap.allocsize, __ATOMIC_RELAXED);
+
+    heap = &defaultHeap;
+
+    if (ptr == NULL || (unsigned long)ptr % 8 != 0 || start == NULL ||
+        ptr < (void*)start || ptr >= (void*)start + allocsize) {
+        return -1;
+    }
+    // the header of an allocated block is only written by whoever frees it
+    blockHeader *block = ptr - sizeof(blockHeader);
+    hsize size_status = __atomic_load_n(&block->size_status, __ATOMIC_RELAXED);
+    if ((size_status & 1) == 0) {
+        return -1;
+    }
+    int index = (size_status - size_status % 8) / 8;
+    if (index >= TCACHE_CLASSES) {
+        return 1;
+    }
+    // another thread's block would hand this thread its cache lines
+    if (defaultHeap.lines != NULL && __atomic_load_n(&lineOf(ptr)->owner, __ATOMIC_RELAXED) != tcache.id) {
+        return 1;
+    }
+
+    // a cached block is still allocated, so look for it in the list
+    if (entryOf(block)->key == tcache.id) {
+        for (hsize offset = tcache.lists[index]; offset != NO_BLOCK;
+             offset = entryOf(blockAt(offset))->next) {
+            if (blockAt(offset) == block) {
+                return -1;
+            }
+        }
+    }
+
+    if (tcache.counts[index] >= defaultHeap.opt.tcacheCount) {
+        pthread_mutex_lock(&defaultHeap.lock);
+        heap = &defaultHeap;
+        tcacheFlush(index, (defaultHeap.opt.tcacheCount + 1) / 2);
+        pthread_mutex_unlock(&defaultHeap.lock);
+    }
+    tcachePush(index, block);
+    return 0;
+}
+
+// takes a depot's lock, growing its magazines if it is often contended
+static void depotLock(depot *d) {
+    int contended = pthread_mutex_trylock(&d->lock) != 0;
+    if (contended) {
+        pthread_mutex_lock(&d->lock);
+    }
+    d->contended += contended;
+    if (++d->uses == 256) {
+        if (d->contended * MAGAZINE_CONTENTION > d->uses && d->magazineSize < MAGAZINE_MAX) {
+            d->magazineSize = d->magazineSize * 2 < MAGAZINE_MAX ? d->magazineSize * 2 : MAGAZINE_MAX;
+        }
+        d->uses = 0;
+        d->contended = 0;
+    }
+}
+
+// a new empty magazine from the default heap, heap lock held
+static magazine* magazineNew(int capacity) {
+    magazine *m = heapAlloc(sizeof(magazine) + capacity * sizeof(void*));
+    if (m != NULL) {
+        m->rounds = 0;
+        m->capacity = capacity;
+    }
+    return m;
+}
+
+// frees the blocks of a magazine, heap lock held
+static void magazineFlush(magazine *m) {
+    while (m->rounds > 0) {
+        heapFree(m->slots[--m->rounds]);
+    }
+}
+
+/*
+ * myAlloc for a block of 'size' bytes through the magazines.  With both
+ * of the thread's magazines empty the previous one is traded for a full
+ * one at the depot, and if the depot has none the loaded magazine is
+ * filled half way from the heap under one lock.
+ */
+static void* magazineAlloc(hsize size) {
+    int index = size / 8;
+    magazine *m = tcache.loaded[index];
+
+    if (m != NULL && m->rounds > 0) {
+        return cacheTake(m->slots[--m->rounds]);
+    }
+    magazine *prev = tcache.previous[index];
+    if (prev != NULL && prev->rounds > 0) {
+        tcache.previous[index] = m;
+        tcache.loaded[index] = prev;
+        return cacheTake(prev->slots[--prev->rounds]);
+    }
+
+    depot *d = &depots[index];
+    depotLock(d);
+    magazine *full = d->full;
+    if (full != NULL) {
+        d->full = full->next;
+        if (prev != NULL) {
+            prev->next = d->empty;
+            d->empty = prev;
+        }
+        tcache.previous[index] = m;
+        tcache.loaded[index] = full;
+    }
+    int capacity = d->magazineSize;
+    pthread_mutex_unlock(&d->lock);
+    if (full != NULL) {
+        return cacheTake(full->slots[--full->rounds]);
+    }
+
+    pthread_mutex_lock(&defaultHeap.lock);
+    heap = &defaultHeap;
+    if (m == NULL) {
+        m = tcache.loaded[index] = magazineNew(capacity);
+    }
+    void *ptr = heapAlloc(size - sizeof(blockHeader));
+    for (int i = 1; m != NULL && ptr != NULL && i < (m->capacity + 1) / 2; i++) {
+        void *extra = heapAlloc(size - sizeof(blockHeader));
+        if (extra == NULL) {
+            break;
+        }
+        // blocks that came out larger than asked for go back
+        if (blockSize(extra - sizeof(blockHeader)) != size) {
+            heapFree(extra);
+            break;
+        }
+        m->slots[m->rounds++] = extra;
+    }
+    pthread_mutex_unlock(&defaultHeap.lock);
+    return ptr;
+}
+
+/*
+ * myFree through the magazines, with the checks cpuFree makes.  With both
+ * of the thread's magazines full the previous one goes to the depot in
+ * exchange for an empty one, which is made if the depot has none or only
+ * ones smaller than it hands out now.
+ * Returns 0 if the block was taken, -1 for an invalid pointer, or 1 if
+ * the block has to go to the heap.
+ */
+static int magazineFree(void *ptr) {
+    blockHeader *start = defaultHeap.heapStart;
+    hsize allocsize = __atomic_load_n(&defaultHeap.allocsize, __ATOMIC_RELAXED);
+
+    if (ptr == NULL || (unsigned long)ptr % 8 != 0 ||
+        ptr < (void*)start || ptr >= (void*)start + allocsize) {
+        return -1;
+    }
+    blockHeader *block = ptr - sizeof(blockHeader);
+    hsize size_status = __atomic_load_n(&block->size_status, __ATOMIC_RELAXED);
+    if ((size_status & 1) == 0) {
+        return -1;
+    }
+    int index = (size_status - size_status % 8) / 8;
+    if (index >= TCACHE_CLASSES) {
+        return 1;
+    }
+    if (entryOf(block)->key == cacheKey) {
+        return -1;
+    }
+    entryOf(block)->key = cacheKey;
+
+    magazine *m = tcache.loaded[index];
+    if (m != NULL && m->rounds < m->capacity) {
+        m->slots[m->rounds++] = ptr;
+        return 0;
+    }
+    magazine *prev = tcache.previous[index];
+    if (prev != NULL && prev->rounds == 0) {
+        tcache.previous[index] = m;
+        tcache.loaded[index] = prev;
+        prev->slots[prev->rounds++] = ptr;
+        return 0;
+    }
+
+    depot *d = &depots[index];
+    depotLock(d);
+    if (prev != NULL) {
+        prev->next = d->full;
+        d->full = prev;
+    }
+    tcache.previous[index] = m;
+    magazine *empty = d->empty;
+    if (empty != NULL) {
+        d->empty = empty->next;
+    }
+    int capacity = d->magazineSize;
+    pthread_mutex_unlock(&d->lock);
+
+    if (empty == NULL || empty->capacity < capacity) {
+        pthread_mutex_lock(&defaultHeap.lock);
+        heap = &defaultHeap;
+        if (empty != NULL) {
+            heapFree(empty);
+        }
+        empty = magazineNew(capacity);
+        if (empty == NULL) {
+            tcache.loaded[index] = NULL;
+            int result = heapFree(ptr);
+            pthread_mutex_unlock(&defaultHeap.lock);
+            return result;
+        }
+        pthread_mutex_unlock(&defaultHeap.lock);
+    }
+    tcache.loaded[index] = empty;
+    empty->slots[empty->rounds++] = ptr;
+    return 0;
+}
+
+// frees the blocks of a list of magazines and the magazines, heap lock held
+static void magazineFreeAll(magazine *m) {
+    while (m != NULL) {
+        magazine *next = m->next;
+        magazineFlush(m);
+        heapFree(m);
+        m = next;
+    }
+}
+
+/*
+ * Gives the blocks in the calling thread's magazines and in the full
+ * magazines of every depot back to the heap, along with the magazines
+ * themselves and the empty ones of the depots, so that nothing the
+ * magazine layer holds stays allocated.  New ones are made as needed.
+ * The magazines of other threads go to the depots when they exit.
+ */
+static void depotReap() {
+    for (int index = 0; index < TCACHE_CLASSES; index++) {
+        depot *d = &depots[index];
+        depotLock(d);
+        magazine *full = d->full;
+        magazine *empty = d->empty;
+        d->full = d->empty = NULL;
+        pthread_mutex_unlock(&d->lock);
+
+        magazine *loaded = tcache.loaded[index];
+        magazine *previous = tcache.previous[index];
+        tcache.loaded[index] = tcache.previous[index] = NULL;
+        // a thread's magazines are on no depot list, their links are stale
+        if (previous != NULL) {
+            previous->next = NULL;
+        }
+        if (loaded != NULL) {
+            loaded->next = previous;
+        } else {
+            loaded = previous;
+        }
+        if (full == NULL && empty == NULL && loaded == NULL) {
+            continue;
+        }
+
+        pthread_mutex_lock(&defaultHeap.lock);
+        heap = &defaultHeap;
+        magazineFreeAll(full);
+        magazineFreeAll(empty);
+        magazineFreeAll(loaded);
+        pthread_mutex_unlock(&defaultHeap.lock);
+    }
+}
+
+// offset of the top block of a stack head, NO_BLOCK if it is empty
+static hsize stackTop(unsigned long long head) {
+    hsize top = head & ((1ull << STACK_TAG_SHIFT) - 1);
+    return top == 0 ? NO_BLOCK : (top - 1) * 8;
+}
+
+// the head that follows 'head' with 'top' on top of the stack
+static unsigned long long stackNext(unsigned long long head, hsize top) {
+    unsigned long long tag = (head >> STACK_TAG_SHIFT) + 1;
+    return tag << STACK_TAG_SHIFT | (top == NO_BLOCK ? 0 : top / 8 + 1);
+}
+
+// pushes the chain of 'count' blocks from first to last, linked through next
+static void stackPush(int index, blockHeader *first, blockHeader *last, int count) {
+    lockfreeStack *stack = &stacks[index];
+    unsigned long long head = __atomic_load_n(&stack->head, __ATOMIC_RELAXED);
+    unsigned long long next;
+
+    do {
+        __atomic_store_n(&linksOf(last)->next, stackTop(head), __ATOMIC_RELAXED);
+        next = stackNext(head, offsetOf(first));
+    } while (!__atomic_compare_exchange_n(&stack->head, &head, next, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    __atomic_add_fetch(&stack->count, count, __ATOMIC_RELAXED);
+}
+
+// pops the top block of a stack, NULL if it is empty
+static blockHeader* stackPop(int index) {
+    lockfreeStack *stack = &stacks[index];
+    unsigned long long head = __atomic_load_n(&stack->head, __ATOMIC_ACQUIRE);
+    unsigned long long next;
+    hsize top;
+
+    do {
+        top = stackTop(head);
+        if (top == NO_BLOCK) {
+            return NULL;
+        }
+        // if the block was popped in the meantime the tag has moved on
+        // and the compare-and-swap fails, whatever was read here
+        next = stackNext(head, __atomic_load_n(&linksOf(blockAt(top))->next, __ATOMIC_RELAXED));
+    } while (!__atomic_compare_exchange_n(&stack->head, &head, next, 1,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+    __atomic_sub_fetch(&stack->count, 1, __ATOMIC_RELAXED);
+    return blockAt(top);
+}
+
+// takes all blocks off the stacks and frees them into the heap
+static void stackReap() {
+    heap = &defaultHeap;
+    for (int index = 0; index < TCACHE_CLASSES; index++) {
+        lockfreeStack *stack = &stacks[index];
+        unsigned long long head = __atomic_load_n(&stack->head, __ATOMIC_ACQUIRE);
+        while (stackTop(head) != NO_BLOCK &&
+               !__atomic_compare_exchange_n(&stack->head, &head, stackNext(head, NO_BLOCK), 1,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        }
+        hsize offset = stackTop(head);
+        if (offset == NO_BLOCK) {
+            continue;
+        }
+
+        pthread_mutex_lock(&defaultHeap.lock);
+        heap = &defaultHeap;
+        long count = 0;
+        while (offset != NO_BLOCK) {
+            blockHeader *block = blockAt(offset);
+            offset = linksOf(block)->next;
+            heapFree((void*)block + sizeof(blockHeader));
+            count++;
+        }
+        pthread_mutex_unlock(&defaultHeap.lock);
+        __atomic_sub_fetch(&stack->count, count, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * myAlloc for a block of 'size' bytes through the stacks.  An empty stack
+ * is refilled with a batch from the heap, and when the heap has no block
+ * left the blocks on all stacks are given back to it first.
+ */
+static void* stackAlloc(hsize size) {
+    int index = size / 8;
+
+    heap = &defaultHeap;
+    blockHeader *block = stackPop(index);
+    if (block != NULL) {
+        return cacheTake((void*)block + sizeof(blockHeader));
+    }
+
+    pthread_mutex_lock(&defaultHeap.lock);
+    heap = &defaultHeap;
+    void *ptr = heapAlloc(size - sizeof(blockHeader));
+    if (ptr == NULL) {
+        pthread_mutex_unlock(&defaultHeap.lock);
+        stackReap();
+        pthread_mutex_lock(&defaultHeap.lock);
+        heap = &defaultHeap;
+        ptr = heapAlloc(size - sizeof(blockHeader));
+    }
+
+    // the first block is handed out, the rest of the batch goes on the stack
+    int batch = defaultHeap.opt.stackCount / 2 < STACK_BATCH ? defaultHeap.opt.stackCount / 2 : STACK_BATCH;
+    blockHeader *first = NULL;
+    blockHeader *last = NULL;
+    int count = 0;
+    while (ptr != NULL && count < batch) {
+        void *extra = heapAlloc(size - sizeof(blockHeader));
+        if (extra == NULL) {
+            break;
+        }
+        block = extra - sizeof(blockHeader);
+        if (blockSize(block) != size) {
+            heapFree(extra);
+            break;
+        }
+        if (first == NULL) {
+            last = block;
+        } else {
+            linksOf(block)->next = offsetOf(first);
+        }
+        first = block;
+        count++;
+    }
+    pthread_mutex_unlock(&defaultHeap.lock);
+
+    if (count > 0) {
+        stackPush(index, first, last, count);
+    }
+    return ptr;
+}
+
+/*
+ * myFree through the stacks, with the checks cpuFree makes.
+ * Returns 0 if the block was pushed, -1 for an invalid pointer, or 1 if
+ * the block has to go to the heap.
+ */
+static int stackFree(void *ptr) {
+    blockHeader *start = defaultHeap.heapStart;
+    hsize allocsize = __atomic_load_n(&defaultHeap.allocsize, __ATOMIC_RELAXED);
+
+    if (ptr == NULL || (unsigned long)ptr % 8 != 0 ||
+        ptr < (void*)start || ptr >= (void*)start + allocsize) {
+        return -1;
+    }
+    blockHeader *block = ptr - sizeof(blockHeader);
+    hsize size_status = __atomic_load_n(&block->size_status, __ATOMIC_RELAXED);
+    if ((size_status & 1) == 0) {
+        return -1;
+    }
+    hsize size = size_status - size_status % 8;
+    if (size > tcacheSize(STACK_LIMIT)) {
+        return 1;
+    }
+    // checked before the count, a block on a full stack must not reach heapFree
+    if (entryOf(block)->key == cacheKey) {
+        return -1;
+    }
+    int index = size / 8;
+    if (__atomic_load_n(&stacks[index].count, __ATOMIC_RELAXED) >= defaultHeap.opt.stackCount) {
+        return 1;
+    }
+
+    heap = &defaultHeap;
+    entryOf(block)->key = cacheKey;
+    stackPush(index, block, block, 1);
+    return 0;
+}
+
+/*
+ * myAlloc for a block of 'size' bytes that fits the per-CPU caches.  An
+ * empty stack is refilled like an empty per-thread cache list.
+ */
+static void* cpuAlloc(hsize size) {
+    int limit = defaultHeap.opt.cpuCacheCount;
+    int index = size / 8;
+    void *ptr;
+
+    if (cpuPop(index, &ptr) == 0) {
+        return cacheTake(ptr);
+    }
+
+    pthread_mutex_lock(&defaultHeap.lock);
+    heap = &defaultHeap;
+    ptr = heapAlloc(size - sizeof(blockHeader));
+    for (int i = 1; ptr != NULL && i < (limit + 1) / 2; i++) {
+        void *extra = heapAlloc(size - sizeof(blockHeader));
+        if (extra == NULL) {
+            break;
+        }
+        int own = blockSize(extra - sizeof(blockHeader)) / 8;
+        if (own >= TCACHE_CLASSES || cpuPush(own, extra, limit) != 0) {
+            heapFree(extra);
+        }
+    }
+    pthread_mutex_unlock(&defaultHeap.lock);
+    return ptr;
+}
+
+/*
+ * myFree through the per-CPU caches, with the checks tcacheFree makes,
+ * the double free check through the mark of cacheKey.  A full stack
+ * gives half of its blocks and the freed block back to the heap under
+ * one lock.
+ * Returns 0 if the block was cached or freed, -1 for an invalid pointer,
+ * or 1 if the block has to go to the heap.
+ */
+static int cpuFree(void *ptr) {
+    blockHeader *start = defaultHeap.heapStart;
+    hsize allocsize = __atomic_load_n(&defaultHeap.allocsize, __ATOMIC_RELAXED);
+    int limit = defaultHeap.opt.cpuCacheCount;
+
+    if (ptr == NULL || (unsigned long)ptr % 8 != 0 ||
+        ptr < (void*)start || ptr >= (void*)start + allocsize) {
+        return -1;
+    }
+    blockHeader *block = ptr - sizeof(blockHeader);
+    hsize size_status = __atomic_load_n(&block->size_status, __ATOMIC_RELAXED);
+    if ((size_status & 1) == 0) {
+        return -1;
+    }
+    int index = (size_status - size_status % 8) / 8;
+    if (index >= TCACHE_CLASSES) {
+        return 1;
+    }
+    if (entryOf(block)->key == cacheKey) {
+        return -1;
+    }
+
+    // marked before another thread on this CPU can pop it and clear the mark
+    entryOf(block)->key = cacheKey;
+    if (cpuPush(index, ptr, limit) == 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&defaultHeap.lock);
+    heap = &defaultHeap;
+    void *cached;
+    for (int i = 0; i < limit / 2 && cpuPop(index, &cached) == 0; i++) {
+        heapFree(cached);
+    }
+    int result = heapFree(ptr);
+    pthread_mutex_unlock(&defaultHeap.lock);
+    return result;
+}
+
+/*
+ * Gives the blocks in the per-CPU caches back to the heap from the calling
+ * thread, wherever it runs.  A CPU's stacks are only changed in sequences
+ * that give up while its 'draining' flag is set, so once the flag is set
+ * and a membarrier fence has restarted the sequences that started before
+ * it, the stacks are left to this thread.  Until the flag is cleared
+ * again the threads on that CPU take the locked path of the heap.  Must
+ * be called while holding the lock of the default heap.
+ */
+static void cpuReap() {
+    for (int cpu = 0; cpu < cpuCount; cpu++) {
+        cpuCache *cache = &cpuCaches[cpu];
+        // the counts are only read to skip empty caches, a block pushed
+        // since then waits for the next call
+        long cached = 0;
+        for (int index = 0; index < TCACHE_CLASSES; index++) {
+            cached += __atomic_load_n(&cache->counts[index], __ATOMIC_RELAXED);
+        }
+        if (cached == 0) {
+            continue;
+        }
+
+        __atomic_store_n(&cache->draining, 1, __ATOMIC_SEQ_CST);
+        if (cpuFence(cpu) == 0) {
+            for (int index = 0; index < TCACHE_CLASSES; index++) {
+                long count = __atomic_load_n(&cache->counts[index], __ATOMIC_ACQUIRE);
+                for (long i = 0; i < count; i++) {
+                    heapFree(cache->slots[index][i]);
+                }
+                __atomic_store_n(&cache->counts[index], 0, __ATOMIC_RELAXED);
+            }
+        }
+        __atomic_store_n(&cache->draining, 0, __ATOMIC_RELEASE);
+    }
+}
+
+// pthread key destructor, runs when a thread with a cache or arena exits
+static void threadExit(void *unused) {
+    (void)unused;
+    if (defaultHeap.opt.tcacheCount > 0) {
+        pthread_mutex_lock(&defaultHeap.lock);
+        heap = &defaultHeap;
+        tcacheFlushAll();
+        pthread_mutex_unlock(&defaultHeap.lock);
+    }
+
+    // full magazines go to the depot, the rest are emptied into the heap
+    for (int index = 0; index < TCACHE_CLASSES; index++) {
+        magazine *held[2] = { tcache.loaded[index], tcache.previous[index] };
+        tcache.loaded[index] = tcache.previous[index] = NULL;
+        for (int i = 0; i < 2; i++) {
+            magazine *m = held[i];
+            if (m == NULL) {
+                continue;
+            }
+            if (m->rounds > 0 && m->rounds < m->capacity) {
+                pthread_mutex_lock(&defaultHeap.lock);
+                heap = &defaultHeap;
+                magazineFlush(m);
+                pthread_mutex_unlock(&defaultHeap.lock);
+            }
+            depot *d = &depots[index];
+            depotLock(d);
+            if (m->rounds > 0) {
+                m->next = d->full;
+                d->full = m;
+            } else {
+                m->next = d->empty;
+                d->empty = m;
+            }
+            pthread_mutex_unlock(&d->lock);
+        }
+    }
+    if (arena != NULL) {
+        __atomic_store_n(&arena->owner, 0, __ATOMIC_RELEASE);
+        arena = NULL;
+    }
+
+    // retired blocks wait for the epoch with those of other exited threads,
+    // a limbo of an epoch 3 older is merged in and waits a little longer
+    if (tcache.record != NULL) {
+        pthread_mutex_lock(&orphanLock);
+        for (int i = 0; i < 3; i++) {
+            limbo *own = &tcache.retired[i];
+            if (own->batches == NULL) {
+                continue;
+            }
+            limbo *orphan = &orphans[i];
+            if (orphan->batches == NULL || orphan->epoch < own->epoch) {
+                orphan->epoch = own->epoch;
+            }
+            magazine *last = own->batches;
+            while (last->next != NULL) {
+                last = last->next;
+            }
+            last->next = orphan->batches;
+            orphan->batches = own->batches;
+            own->batches = NULL;
+        }
+        pthread_mutex_unlock(&orphanLock);
+
+        tcache.epochDepth = 0;
+        __atomic_store_n(&tcache.record->state, 0, __ATOMIC_RELEASE);
+        __atomic_store_n(&tcache.record->owned, 0, __ATOMIC_RELEASE);
+        tcache.record = NULL;
+    }
+}
+
+static void threadKeyCreate() {
+    pthread_key_create(&threadKey, threadExit);
+}
+
+// gives the calling thread its id and registers its exit handler
+static void threadStart() {
+    pthread_once(&threadOnce, threadKeyCreate);
+    tcache.id = __atomic_add_fetch(&threadIds, 1, __ATOMIC_RELAXED);
+    if (tcache.id == 0) {
+        tcache.id = __atomic_add_fetch(&threadIds, 1, __ATOMIC_RELAXED);
+    }
+    for (int index = 0; index < TCACHE_CLASSES; index++) {
+        tcache.lists[index] = NO_BLOCK;
+    }
+    pthread_setspecific(threadKey, &tcache);
+}
+
+// the arena whose reservation holds ptr, or NULL
+static myHeap* arenaOf(void *ptr) {
+    int count = __atomic_load_n(&arenaCount, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        void *start = arenas[i]->heapStart;
+        if (ptr >= start && ptr < start + arenas[i]->reservesize) {
+            return arenas[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Gives the calling thread an arena, adopting one without an owner or
+ * creating a new one.  Returns NULL if there are MAX_ARENAS arenas
+ * already or a new one cannot be mapped.
+ */
+static myHeap* arenaAttach() {
+    pthread_mutex_lock(&arenaLock);
+    for (int i = 0; i < arenaCount && arena == NULL; i++) {
+        if (__atomic_load_n(&arenas[i]->owner, __ATOMIC_ACQUIRE) == 0) {
+            arena = arenas[i];
+        }
+    }
+    if (arena == NULL && arenaCount < MAX_ARENAS) {
+        myHeap *h = mmap(NULL, sizeof(myHeap), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED != h && heapInit(h, &defaultHeap.opt, arenaSize) == 0) {
+            pthread_mutex_init(&h->lock, NULL);
+            arenas[arenaCount] = h;
+            __atomic_store_n(&arenaCount, arenaCount + 1, __ATOMIC_RELEASE);
+            arena = h;
+        } else if (MAP_FAILED != h) {
+            munmap(h, sizeof(myHeap));
+        }
+    }
+    if (arena != NULL) {
+        arena->owner = tcache.id;
+    }
+    pthread_mutex_unlock(&arenaLock);
+    return arena;
+}
+
+// frees the blocks other threads freed into the current heap
+static void arenaDrain() {
+    if (__atomic_load_n(&heap->remoteFrees, __ATOMIC_RELAXED) == NO_BLOCK) {
+        return;
+    }
+    hsize offset = __atomic_exchange_n(&heap->remoteFrees, NO_BLOCK, __ATOMIC_ACQUIRE);
+    while (offset != NO_BLOCK) {
+        blockHeader *block = blockAt(offset);
+        offset = linksOf(block)->next;
+        heapFree((void*)block + sizeof(blockHeader));
+    }
+}
+
+/*
+ * Frees the blocks waiting in the remote lists of the arenas without an
+ * owner and merges them, for coalesce().  Each arena is claimed while it
+ * is drained so that no thread adopts it meanwhile, with an owner id no
+ * thread has.
+ */
+static void arenaDrainOrphans() {
+    int count = __atomic_load_n(&arenaCount, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        myHeap *h = arenas[i];
+        if (__atomic_load_n(&h->remoteFrees, __ATOMIC_RELAXED) == NO_BLOCK) {
+            continue;
+        }
+        pthread_mutex_lock(&arenaLock);
+        int orphan = __atomic_load_n(&h->owner, __ATOMIC_ACQUIRE) == 0;
+        if (orphan) {
+            h->owner = ~0u;
+        }
+        pthread_mutex_unlock(&arenaLock);
+        if (!orphan) {
+            continue;
+        }
+
+        // thieves take the lock of any arena
+        pthread_mutex_lock(&h->lock);
+        heap = h;
+        arenaDrain();
+        heapCoalesce();
+        pthread_mutex_unlock(&h->lock);
+        __atomic_store_n(&h->owner, 0, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+ * myAlloc from the arenas of other threads, for a thread whose own arena
+ * is exhausted.  The first round goes over the peers from one picked by
+ * thread id and only takes the arenas whose lock is free, so thieves
+ * spread out and do not queue behind a busy owner while an idle peer has
+ * room.  The second round waits for every lock and merges the peer's
+ * free blocks before giving up on it.  A peer is never grown, its mapping
+ * is only for its owner to extend.
+ * Returns NULL if no arena has a large enough block.
+ */
+static void* arenaSteal(myHeapSize size) {
+    int count = __atomic_load_n(&arenaCount, __ATOMIC_ACQUIRE);
+    int start = tcache.id % count;
+
+    for (int wait = 0; wait < 2; wait++) {
+        for (int i = 0; i < count; i++) {
+            myHeap *h = arenas[(start + i) % count];
+            if (h == arena) {
+                continue;
+            }
+            if (wait) {
+                pthread_mutex_lock(&h->lock);
+            } else if (pthread_mutex_trylock(&h->lock) != 0) {
+                continue;
+            }
+            heap = h;
+            arenaDrain();
+            allocNoGrow = 1;
+            void *ptr = heapAlloc(size);
+            if (ptr == NULL && wait) {
+                heapCoalesce();
+                ptr = heapAlloc(size);
+            }
+            allocNoGrow = 0;
+            pthread_mutex_unlock(&h->lock);
+            if (ptr != NULL) {
+                pthread_mutex_lock(&arena->lock);
+                arena->steals++;
+                pthread_mutex_unlock(&arena->lock);
+                return ptr;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void* arenaAlloc(myHeapSize size) {
+    if (arena == NULL) {
+        if (tcache.id == 0) {
+            threadStart();
+        }
+        if (arenaAttach() == NULL) {
+            return NULL;
+        }
+    }
+    if (!defaultHeap.opt.steal) {
+        heap = arena;
+        arenaDrain();
+        return heapAlloc(size);
+    }
+
+    // the free blocks of the peers are used before the arena grows
+    pthread_mutex_lock(&arena->lock);
+    heap = arena;
+    arenaDrain();
+    allocNoGrow = 1;
+    void *ptr = heapAlloc(size);
+    allocNoGrow = 0;
+    pthread_mutex_unlock(&arena->lock);
+    if (ptr == NULL) {
+        ptr = arenaSteal(size);
+    }
+    if (ptr == NULL && arena->opt.maxSize > 0) {
+        pthread_mutex_lock(&arena->lock);
+        heap = arena;
+        ptr = heapAlloc(size);
+        pthread_mutex_unlock(&arena->lock);
+    }
+    return ptr;
+}
+
+/*
+ * Frees a block into the arena it came from, directly if the calling
+ * thread owns the arena and through its remoteFrees otherwise.  A remote
+ * block gets the checks myFree makes that need no lock, and carries the
+ * mark of cacheKey until its owner frees it, which catches it being freed
+ * again meanwhile.
+ */
+static int arenaFree(void *ptr) {
+    myHeap *owner = arenaOf(ptr);
+    if (owner == NULL) {
+        return -1;
+    }
+    // the end mark is no block, and the mark after its header is not mapped
+    hsize allocsize = __atomic_load_n(&owner->allocsize, __ATOMIC_RELAXED);
+    if ((unsigned long)ptr % 8 != 0 || ptr >= (void*)owner->heapStart + allocsize) {
+        return -1;
+    }
+    // checked before the a-bit is, which stays set while the block waits
+    blockHeader *block = ptr - sizeof(blockHeader);
+    if (entryOf(block)->key == cacheKey) {
+        return -1;
+    }
+    if (owner == arena) {
+        if (!defaultHeap.opt.steal) {
+            heap = arena;
+            return heapFree(ptr);
+        }
+        pthread_mutex_lock(&arena->lock);
+        heap = arena;
+        int result = heapFree(ptr);
+        pthread_mutex_unlock(&arena->lock);
+        return result;
+    }
+
+    // the owner only writes the header once it has taken the block off the list
+    if ((__atomic_load_n(&block->size_status, __ATOMIC_RELAXED) & 1) == 0) {
+        return -1;
+    }
+
+    // marked before the owner can take the block off the list and free it
+    entryOf(block)->key = cacheKey;
+    hsize offset = (void*)block - (void*)owner->heapStart;
+    hsize head = __atomic_load_n(&owner->remoteFrees, __ATOMIC_RELAXED);
+    do {
+        linksOf(block)->next = head;
+    } while (!__atomic_compare_exchange_n(&owner->remoteFrees, &head, offset, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return 0;
+}
+
+// the shard whose range holds ptr, or NULL
+static myHeap* shardOf(void *ptr) {
+    for (int i = 0; i < shardCount; i++) {
+        void *start = shards[i]->heapStart;
+        if (ptr >= start && ptr < start + shards[i]->reservesize) {
+            return shards[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * myAlloc over the shards.  A first pass goes round the shards from the
+ * thread's home shard and only takes locks that are free.  If no shard was
+ * free or had room it goes round again waiting for every lock.
+ */
+static void* shardAlloc(myHeapSize size) {
+    if (tcache.id == 0) {
+        threadStart();
+    }
+    int home = tcache.id % shardCount;
+
+    for (int wait = 0; wait < 2; wait++) {
+        for (int i = 0; i < shardCount; i++) {
+            myHeap *h = shards[(home + i) % shardCount];
+            if (wait) {
+                pthread_mutex_lock(&h->lock);
+            } else if (pthread_mutex_trylock(&h->lock) != 0) {
+                continue;
+            }
+            heap = h;
+            void *ptr = heapAlloc(size);
+            pthread_mutex_unlock(&h->lock);
+            if (ptr != NULL) {
+                return ptr;
+            }
+        }
+    }
+    return NULL;
+}
+
+static int shardFree(void *ptr) {
+    myHeap *h = shardOf(ptr);
+    if (h == NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&h->lock);
+    heap = h;
+    int result = heapFree(ptr);
+    pthread_mutex_unlock(&h->lock);
+    return result;
+}
+
+// runs the calls published in all slots of a heap, lock held
+static void combineAll(myHeap *h) {
+    if (__atomic_load_n(&h->pending, __ATOMIC_ACQUIRE) == 0) {
+        return;
+    }
+    heap = h;
+    for (int i = 0; i < COMBINE_SLOTS; i++) {
+        combineSlot *slot = &h->slots[i];
+        int op = __atomic_load_n(&slot->op, __ATOMIC_ACQUIRE);
+        if (op == COMBINE_ALLOC) {
+            // placed for the thread that asked, see isolateAlloc
+            allocFor = slot->thread;
+            int own = lastRetry;
+            lastRetry = MYHEAP_RETRY_NONE;
+            slot->ptr = heapAlloc(slot->size);
+            slot->result = lastRetry;
+            lastRetry = own;
+            allocFor = 0;
+        } else if (op == COMBINE_FREE) {
+            slot->result = heapFree(slot->ptr);
+        } else {
+            continue;
+        }
+        __atomic_sub_fetch(&h->pending, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->op, COMBINE_NONE, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+ * Publishes a myAlloc or myFree call in the caller's slot of the heap and
+ * returns once it has run, combining the calls of all threads whenever it
+ * gets the lock in the meantime.
+ * Returns the slot holding the result, which the caller gives up with
+ * combineDone, or NULL if the slot is busy.
+ */
+static combineSlot* combine(myHeap *h, int op, myHeapSize size, void *ptr) {
+    if (tcache.id == 0) {
+        threadStart();
+    }
+    combineSlot *slot = &h->slots[tcache.id % COMBINE_SLOTS];
+    if (__atomic_exchange_n(&slot->busy, 1, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+
+    slot->size = size;
+    slot->ptr = ptr;
+    slot->thread = tcache.id;
+    __atomic_add_fetch(&h->pending, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->op, op, __ATOMIC_RELEASE);
+    for (int spins = 0; __atomic_load_n(&slot->op, __ATOMIC_ACQUIRE) != COMBINE_NONE; spins++) {
+        if (pthread_mutex_trylock(&h->lock) == 0) {
+            combineAll(h);
+            pthread_mutex_unlock(&h->lock);
+        } else if (spins >= COMBINE_SPINS) {
+            sched_yield();
+        }
+    }
+    return slot;
+}
+
+static void combineDone(combineSlot *slot) {
+    __atomic_store_n(&slot->busy, 0, __ATOMIC_RELEASE);
+}
+
+// the calling thread's epoch record, adopting one an exited thread left
+static epochRecord* epochRecordOf() {
+    if (tcache.record != NULL) {
+        return tcache.record;
+    }
+    // threadExit hands the record and the limbos on
+    if (tcache.id == 0) {
+        threadStart();
+    }
+
+    epochRecord *record;
+    for (record = __atomic_load_n(&epochRecords, __ATOMIC_ACQUIRE); record != NULL; record = record->next) {
+        int owned = 0;
+        if (__atomic_load_n(&record->owned, __ATOMIC_RELAXED) == 0 &&
+            __atomic_compare_exchange_n(&record->owned, &owned, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            tcache.record = record;
+            return record;
+        }
+    }
+
+    record = mmap(NULL, sizeof(epochRecord), PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == record) {
+        return NULL;
+    }
+    record->owned = 1;
+    record->next = __atomic_load_n(&epochRecords, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&epochRecords, &record->next, record, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    tcache.record = record;
+    return record;
+}
+
+/*
+ * Moves the global epoch on by one if every thread inside myEnter has
+ * seen the current one.  Returns the epoch as it is now.
+ */
+static unsigned long epochAdvance() {
+    unsigned long epoch = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    for (epochRecord *record = __atomic_load_n(&epochRecords, __ATOMIC_ACQUIRE); record != NULL; record = record->next) {
+        unsigned long state = __atomic_load_n(&record->state, __ATOMIC_SEQ_CST);
+        if ((state & 1) && state >> 1 != epoch) {
+            return epoch;
+        }
+    }
+
+    // another thread may have moved it on first, the epoch it got is as good
+    if (__atomic_compare_exchange_n(&globalEpoch, &epoch, epoch + 1, 0,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        epoch++;
+    }
+    return epoch;
+}
+
+// gives the blocks of a limbo back to the heap, one lock per magazine
+static void limboFree(limbo *bag) {
+    magazine *m = bag->batches;
+    bag->batches = NULL;
+
+    while (m != NULL) {
+        magazine *next = m->next;
+        // arenas and shards each have their own heap, myFree finds it
+        if (defaultHeap.opt.arenas || shardCount > 1) {
+            while (m->rounds > 0) {
+                myFree(m->slots[--m->rounds]);
+            }
+        } else {
+            pthread_mutex_lock(&defaultHeap.lock);
+            heap = &defaultHeap;
+            magazineFlush(m);
+            pthread_mutex_unlock(&defaultHeap.lock);
+        }
+        myFree(m);
+        m = next;
+    }
+}
+
+// frees the limbos no thread can still be reading at 'epoch'
+static void limboCollect(limbo *bags, unsigned long epoch) {
+    for (int i = 0; i < 3; i++) {
+        if (bags[i].batches != NULL && bags[i].epoch + 2 <= epoch) {
+            limboFree(&bags[i]);
+        }
+    }
+}
+
+// frees the thread's and the orphaned limbos that are old enough
+static void retireCollect(unsigned long epoch) {
+    limboCollect(tcache.retired, epoch);
+    if (pthread_mutex_trylock(&orphanLock) == 0) {
+        limboCollect(orphans, epoch);
+        pthread_mutex_unlock(&orphanLock);
+    }
+}
+
+/*
+ * Function for starting to read blocks that other threads may retire,
+ * see myHeap.h.  Calls nest, only the outermost one counts.
+ * Returns 0 on success.
+ * Returns -1 if the thread cannot get an epoch record.
+ */
+int myEnter() {
+    epochRecord *record = epochRecordOf();
+    if (record == NULL) {
+        return -1;
+    }
+    if (tcache.epochDepth++ == 0) {
+        unsigned long epoch = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&record->state, epoch * 2 + 1, __ATOMIC_SEQ_CST);
+        // the blocks are only read after the record is visible
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+    return 0;
+}
+
+/*
+ * Function for ending what myEnter started.
+ * Returns 0 on success.
+ * Returns -1 without a matching myEnter.
+ */
+int myLeave() {
+    if (tcache.epochDepth == 0) {
+        return -1;
+    }
+    if (--tcache.epochDepth == 0) {
+        __atomic_store_n(&tcache.record->state, 0, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+/*
+ * Function for freeing a block once no thread can still be reading it.
+ * Argument ptr: address of a block from myAlloc, already unlinked from
+ * whatever structure other threads found it through.
+ * Returns 0 on success.
+ * Returns -1 if ptr is NULL or not a multiple of 8, or if there is no
+ * room to record it, the block is then not freed.
+ */
+int myRetire(void *ptr) {
+    if (ptr == NULL || (unsigned long)ptr % 8 != 0) {
+        return -1;
+    }
+    if (epochRecordOf() == NULL) {
+        return -1;
+    }
+
+    unsigned long epoch = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+    limbo *bag = &tcache.retired[epoch % 3];
+
+    // a limbo of an epoch 3 or more back has long been safe to free
+    if (bag->batches != NULL && bag->epoch != epoch) {
+        limboFree(bag);
+    }
+    bag->epoch = epoch;
+
+    magazine *m = bag->batches;
+    if (m == NULL || m->rounds == m->capacity) {
+        // a full magazine is the time to free what has become safe
+        if (m != NULL) {
+            retireCollect(epochAdvance());
+        }
+        m = myAlloc(sizeof(magazine) + RETIRE_BATCH * sizeof(void*));
+        if (m == NULL) {
+            return -1;
+        }
+        m->rounds = 0;
+        m->capacity = RETIRE_BATCH;
+        m->next = bag->batches;
+        bag->batches = m;
+    }
+    m->slots[m->rounds++] = ptr;
+    return 0;
+}
+
+/*
+ * Function for allocating from a given heap, see heapAlloc.  Small blocks
+ * of the default heap come from the per-CPU caches, the magazines, the
+ * lock-free stacks or the per-thread cache, whichever is on.  With MYHEAP_OPT_COMBINING the call
+ * may be run by another thread, see combine.
+ */
+void* myHeapAlloc(myHeap *h, myHeapSize size) {
+    lastRetry = MYHEAP_RETRY_NONE;
+    if (h == NULL) {
+        return NULL;
+    }
+
+    if (h == &defaultHeap && cpuCaches != NULL) {
+        hsize block = tcacheSize(size);
+        if (block > 0 && block < TCACHE_LIMIT) {
+            return cpuAlloc(block);
+        }
+    }
+
+    if (h == &defaultHeap && h->opt.magazineSize > 0) {
+        hsize block = tcacheSize(size);
+        if (block > 0 && block < TCACHE_LIMIT) {
+            if (tcache.id == 0) {
+                threadStart();
+            }
+            return magazineAlloc(block);
+        }
+    }
+
+    if (h == &defaultHeap && h->opt.stackCount > 0 && size > 0 && size <= STACK_LIMIT) {
+        return stackAlloc(tcacheSize(size));
+    }
+
+    if (h == &defaultHeap && h->opt.tcacheCount > 0) {
+        hsize block = tcacheSize(size);
+        if (block > 0 && block < TCACHE_LIMIT) {
+            if (tcache.id == 0) {
+                threadStart();
+            }
+            return tcacheAlloc(block);
+        }
+    }
+
+    // blocks are placed by the id of the thread they are for
+    if (h->lines != NULL && tcache.id == 0) {
+        threadStart();
+    }
+
+    if (h->opt.combining) {
+        // an uncontended call runs at once, with whatever was published meanwhile
+        if (pthread_mutex_trylock(&h->lock) == 0) {
+            heap = h;
+            void *ptr = heapAlloc(size);
+            combineAll(h);
+            pthread_mutex_unlock(&h->lock);
+            return ptr;
+        }
+        combineSlot *slot = combine(h, COMBINE_ALLOC, size, NULL);
+        if (slot != NULL) {
+            void *ptr = slot->ptr;
+            lastRetry = slot->result;
+            combineDone(slot);
+            return ptr;
+        }
+    }
+
+    pthread_mutex_lock(&h->lock);
+    heap = h;
+    void *ptr = heapAlloc(size);
+    pthread_mutex_unlock(&h->lock);
+    return ptr;
+}
+
+void* myAlloc(myHeapSize size) {
+    lastRetry = MYHEAP_RETRY_NONE;
+    if (defaultHeap.opt.arenas) {
+        return arenaAlloc(size);
+    }
+    if (shardCount > 1) {
+        return shardAlloc(size);
+    }
+    return myHeapAlloc(&defaultHeap, size);
+}
+
+/*
+ * Function for freeing into a given heap, see heapFree.  Small blocks of
+ * the default heap go into the per-CPU caches, the magazines, the
+ * lock-free stacks or the per-thread cache, whichever is on.  With MYHEAP_OPT_COMBINING the call
+ * may be run by another thread, see combine.
+ */
+int myHeapFree(myHeap *h, void *ptr) {
+    if (h == NULL) {
+        return -1;
+    }
+
+    if (h == &defaultHeap && cpuCaches != NULL) {
+        int cached = cpuFree(ptr);
+        if (cached <= 0) {
+            return cached;
+        }
+    }
+
+    if (h == &defaultHeap && h->opt.magazineSize > 0) {
+        if (tcache.id == 0) {
+            threadStart();
+        }
+        int cached = magazineFree(ptr);
+        if (cached <= 0) {
+            return cached;
+        }
+    }
+
+    if (h == &defaultHeap && h->opt.stackCount > 0) {
+        int cached = stackFree(ptr);
+        if (cached <= 0) {
+            return cached;
+        }
+    }
+
+    if (h == &defaultHeap && h->opt.tcacheCount > 0) {
+        if (tcache.id == 0) {
+            threadStart();
+        }
+        int cached = tcacheFree(ptr);
+        if (cached <= 0) {
+            return cached;
+        }
+    }
+
+    if (h->opt.combining) {
+        if (pthread_mutex_trylock(&h->lock) == 0) {
+            heap = h;
+            int result = heapFree(ptr);
+            combineAll(h);
+            pthread_mutex_unlock(&h->lock);
+            return result;
+        }
+        combineSlot *slot = combine(h, COMBINE_FREE, 0, ptr);
+        if (slot != NULL) {
+            int result = slot->result;
+            combineDone(slot);
+            return result;
+        }
+    }
+
+    pthread_mutex_lock(&h->lock);
+    heap = h;
+    int result = heapFree(ptr);
+    pthread_mutex_unlock(&h->lock);
+    return result;
+}
+
+int myFree(void *ptr) {
+    if (defaultHeap.opt.arenas) {
+        return arenaFree(ptr);
+    }
+    if (shardCount > 1) {
+        return shardFree(ptr);
+    }
+    return myHeapFree(&defaultHeap, ptr);
+}
+
+// coalesce() for a given heap, returns -1 if the heap is NULL
+int myHeapCoalesce(myHeap *h) {
+	if(h == NULL){
+		return -1;
+	}
+	pthread_mutex_lock(&h -> lock);
+	heap = h;
+	int result = heapCoalesce();
+	pthread_mutex_unlock(&h -> lock);
+	return result;
+}
+
+int coalesce() {
+	//retired blocks go back first, the epoch has to move on twice for the latest.
+	//A thread without a record has no limbos, but those of exited threads wait
+	//for whoever calls this
+	epochAdvance();
+	retireCollect(epochAdvance());
+	//an arena is only ever touched by its owner, which needs no lock
+	if(defaultHeap.opt.arenas){
+		//blocks freed into the arenas of exited threads wait for whoever calls this
+		arenaDrainOrphans();
+		if(arena == NULL){
+			return 1;
+		}
+		//unless other threads may be stealing from it
+		if(defaultHeap.opt.steal){
+			pthread_mutex_lock(&arena -> lock);
+		}
+		heap = arena;
+		arenaDrain();
+		int result = heapCoalesce();
+		if(defaultHeap.opt.steal){
+			pthread_mutex_unlock(&arena -> lock);
+		}
+		return result;
+	}
+	//the caller's own cached blocks go back too, those of other threads
+	//when they exit
+	if(defaultHeap.opt.tcacheCount > 0){
+		pthread_mutex_lock(&defaultHeap.lock);
+		heap = &defaultHeap;
+		tcacheFlushAll();
+		pthread_mutex_unlock(&defaultHeap.lock);
+	}
+	//blocks sitting in magazines can only be merged once they are freed
+	if(defaultHeap.opt.magazineSize > 0){
+		depotReap();
+	}
+	if(defaultHeap.opt.stackCount > 0){
+		stackReap();
+	}
+	if(cpuCaches != NULL){
+		pthread_mutex_lock(&defaultHeap.lock);
+		heap = &defaultHeap;
+		cpuReap();
+		pthread_mutex_unlock(&defaultHeap.lock);
+	}
+	//each shard is merged on its own, no block spans two of them
+	for(int i = 1; i < shardCount; i++){
+		myHeapCoalesce(shards[i]);
+	}
+	return myHeapCoalesce(&defaultHeap);
+}
+                  
+/* 
+ * Function to be used for DEBUGGING to help you visualize your heap structure.
+ * Prints out a list of all the blocks including this information:
+ * No.      : serial number of the block 
+ * Status   : free/used (allocated)
+ * Prev     : status of previous block free/used (allocated)
+ * t_Begin  : address of the first byte in the block (where the header starts) 
+ * t_End    : address of the last byte in the block 
+ * t_Size   : size of the block as stored in the block header
+ * With MYHEAP_OPT_WALK_THREADS a large heap is listed in parallel, see
+ * walkHeap.
+ */                     
+void myHeapDisp(myHeap *h) {     
+ 
+    if (h == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&h->lock);
+    heap = h;
+
+    hsize used_size = 0;
+    hsize free_size = 0;
+
+    fprintf(stdout, 
+	"*********************************** Block List **********************************\n");
+    fprintf(stdout, "No.\tStatus\tPrev\tt_Begin\t\tt_End\t\tt_Size\n");
+    fprintf(stdout, 
+	"---------------------------------------------------------------------------------\n");
+
+    int count = walkSplit();
+    if (count == 1) {
+        walkChunk chunk = { .end = h->allocsize, .firstNumber = 1, .out = stdout };
+        walkBlocks(&chunk);
+        used_size = chunk.usedSize;
+        free_size = chunk.freeSize;
+    } else {
+        walkBegin(count);
+
+        // the blocks are counted first so that every chunk knows its numbers
+        walkHeap(walkBlocks, count);
+        long number = 1;
+        for (int i = 0; i < count; i++) {
+            walkChunk *chunk = &walkChunks[i];
+            chunk->firstNumber = number;
+            number += chunk->blocks;
+            used_size += chunk->usedSize;
+            free_size += chunk->freeSize;
+            chunk->out = open_memstream(&chunk->text, &chunk->textSize);
+        }
+
+        // then listed into a buffer per chunk, a chunk that did not get
+        // one is listed when its turn comes
+        walkHeap(walkBlocks, count);
+        for (int i = 0; i < count; i++) {
+            walkChunk *chunk = &walkChunks[i];
+            if (chunk->out == NULL) {
+                chunk->out = stdout;
+                walkBlocks(chunk);
+            } else {
+                fclose(chunk->out);
+                fwrite(chunk->text, 1, chunk->textSize, stdout);
+                free(chunk->text);
+            }
+        }
+
+        walkEnd();
+    }
+
+    fprintf(stdout, 
+	"---------------------------------------------------------------------------------\n");
     fprintf(stdout, 
 	"*********************************************************************************\n");
-    fprintf(stdout, "Total used size = %4d\n", used_size);
-    fprintf(stdout, "Total free size = %4d\n", free_size);
-    fprintf(stdout, "Total size      = %4d\n", used_size + free_size);
+    fprintf(stdout, "Total used size = %4ld\n", (long)used_size);
+    fprintf(stdout, "Total free size = %4ld\n", (long)free_size);
+    fprintf(stdout, "Total size      = %4ld\n", (long)(used_size + free_size));
     fprintf(stdout, 
 	"*********************************************************************************\n");
     fflush(stdout);
 
+    pthread_mutex_unlock(&h->lock);
     return;  
 } 
 
+void dispMem() {
+    myHeapDisp(arena != NULL ? arena : &defaultHeap);
+    for (int i = 1; i < shardCount; i++) {
+        myHeapDisp(shards[i]);
+    }
+}
+
 
 // end of myHeap.c (sp 2021)                                         
 
@@ -0,0 +1,223 @@
+#ifndef __myHeap_h
+#define __myHeap_h
+
+/*
+ * Sizes are ints by default.  Building with -DMYHEAP_64BIT switches the
+ * allocator to 8-byte block headers and size_t sizes, so that heaps and
+ * single allocations can exceed 2 GiB.  The header width is a property of
+ * the build, not of a heap: a program that needs one large heap pays the
+ * wider headers in its small heaps too, and one that only has small heaps
+ * keeps the 4-byte headers by building without the option.
+ */
+#ifdef MYHEAP_64BIT
+#include <stddef.h>
+typedef size_t myHeapSize;
+#else
+typedef int myHeapSize;
+#endif
+
+int   myInit(myHeapSize sizeOfRegion);
+void  dispMem();
+void* myAlloc(myHeapSize size);
+int   myFree(void *ptr);
+int   coalesce();
+
+/*
+ * Independent heaps.  The functions above work on the default heap set up
+ * by myInit(), these on a heap made by myHeapCreate().  Blocks can only be
+ * freed into the heap they were allocated from.  Every heap has a lock, so
+ * all functions can be called from several threads (link with -pthread).
+ */
+typedef struct myHeap myHeap;
+
+myHeap* myHeapCreate(myHeapSize sizeOfRegion);
+int     myHeapDestroy(myHeap *heap);
+void    myHeapDisp(myHeap *heap);
+void*   myHeapAlloc(myHeap *heap, myHeapSize size);
+int     myHeapFree(myHeap *heap, void *ptr);
+int     myHeapCoalesce(myHeap *heap);
+
+/*
+ * Deferred freeing for lock-free data structures.  A thread reads blocks
+ * of such a structure between myEnter() and myLeave(), which nest, and
+ * passes a block it unlinked to myRetire() instead of myFree().  The block
+ * is freed once every thread that was between myEnter() and myLeave()
+ * when it was retired has left.  Retired blocks are freed in batches by
+ * later myRetire() calls of the same thread and by coalesce().  Only for
+ * blocks from myAlloc().
+ */
+int   myEnter();
+int   myLeave();
+int   myRetire(void *ptr);
+
+/*
+ * Allocator options, set with myOpt() before calling myInit() or
+ * myHeapCreate().  They apply to the heaps created after the call.
+ */
+
+// which free block index myAlloc searches
+#define MYHEAP_OPT_ENGINE          1
+#define MYHEAP_ENGINE_BINS         0   // segregated size-class bins (default)
+#define MYHEAP_ENGINE_TREE         1   // AVL tree keyed by (size, address)
+#define MYHEAP_ENGINE_TLSF         2   // two-level segregated fit, O(1) bounded
+
+// when free blocks are merged with their neighbours
+#define MYHEAP_OPT_COALESCE        2
+#define MYHEAP_COALESCE_DELAYED    0   // only by coalesce() (default)
+#define MYHEAP_COALESCE_IMMEDIATE  1   // by myFree, in constant time
+#define MYHEAP_COALESCE_INCREMENTAL 2  // by coalesce(), freed blocks only
+
+// most freed blocks one incremental coalesce() merges, 0 for all (default),
+// can also be changed on a live heap, by myOpt() for the default heap and
+// by myHeapOpt() for any heap
+#define MYHEAP_OPT_COALESCE_BUDGET 3
+
+// when non-zero myAlloc merges free blocks and retries instead of failing,
+// MYHEAP_STAT_LAST_RETRY tells how that went for a single call
+#define MYHEAP_OPT_RETRY           4
+
+// largest size the heap may grow to when myAlloc runs out, below 2 GiB
+// unless built with MYHEAP_64BIT;
+// 0 or anything below sizeOfRegion keeps the heap fixed (default)
+#define MYHEAP_OPT_MAX_SIZE        5
+
+// how free pages are given back to the OS, and how many milliseconds a
+// block must stay free before its pages are (default 10000)
+#define MYHEAP_OPT_PURGE           6
+#define MYHEAP_PURGE_OFF           0   // pages stay resident (default)
+#define MYHEAP_PURGE_DONTNEED      1   // madvise(MADV_DONTNEED)
+#define MYHEAP_PURGE_FREE          2   // madvise(MADV_FREE)
+#define MYHEAP_OPT_PURGE_DECAY     7
+
+// 2 MiB pages for the heap, falling back to normal pages when unavailable
+#define MYHEAP_OPT_HUGEPAGES       8
+#define MYHEAP_HUGE_OFF            0   // normal pages (default)
+#define MYHEAP_HUGE_THP            1   // transparent huge pages
+#define MYHEAP_HUGE_HUGETLB        2   // hugetlb pool, then transparent
+
+// most blocks below 512 bytes each thread caches per block size for
+// myAlloc and myFree, which then rarely lock the heap; 0 for none (default)
+#define MYHEAP_OPT_TCACHE          9
+
+// when non-zero every thread allocates from an arena of its own, a heap
+// like the default one that it uses without locking; blocks freed by
+// another thread are handed back to the owning arena
+#define MYHEAP_OPT_ARENAS          10
+
+// most blocks below 512 bytes each CPU caches per block size for myAlloc
+// and myFree, at most 64; uses restartable sequences and membarrier and
+// falls back to MYHEAP_OPT_TCACHE with the same count where they are not
+// available; 0 for none (default)
+#define MYHEAP_OPT_CPUCACHE        11
+
+// blocks per magazine that threads cache blocks below 512 bytes in and
+// trade with each other through a depot, at most 512 and grown when the
+// depot is contended; 0 for none (default)
+#define MYHEAP_OPT_MAGAZINES       12
+
+// when non-zero threads hand their myAlloc and myFree calls to whichever
+// thread holds the heap's lock, which runs them all in one batch instead
+// of every thread taking the lock in turn.  A call that finds the lock
+// free runs at once, so without contention it costs what the plain mutex
+// does; it only gains when threads on several cores keep the lock busy
+#define MYHEAP_OPT_COMBINING       13
+
+// most blocks the default heap keeps per block size on lock-free stacks
+// shared by all threads, which serve requests of up to 256 bytes without
+// locking the heap; 0 for none (default)
+#define MYHEAP_OPT_LOCKFREE        14
+
+// number of shards myInit splits the region into, at most 64, each with
+// a lock of its own; myAlloc moves to another shard instead of waiting,
+// and sizeOfRegion and MYHEAP_OPT_MAX_SIZE are shared out among them;
+// 0 or 1 for a single heap (default), ignored with MYHEAP_OPT_ARENAS.
+// myInit then leaves MYHEAP_OPT_TCACHE, MYHEAP_OPT_CPUCACHE,
+// MYHEAP_OPT_MAGAZINES, MYHEAP_OPT_COMBINING and MYHEAP_OPT_LOCKFREE off,
+// which work in front of a single heap
+#define MYHEAP_OPT_SHARDS          15
+
+// with MYHEAP_OPT_ARENAS, when non-zero a thread whose arena is exhausted
+// allocates from the arenas of other threads instead of failing, before
+// growing its own arena and without ever growing theirs
+#define MYHEAP_OPT_STEAL           16
+
+// milliseconds between the rounds of a background thread that coalesces
+// and purges the default heap, so that myFree and coalesce() callers do
+// not have to; 0 for none (default), ignored with MYHEAP_OPT_ARENAS
+#define MYHEAP_OPT_RECLAIM         17
+
+// number of threads, at most 64, that walk a heap in parallel for
+// coalesce(), dispMem() and the MYHEAP_STAT_*_SIZE counters, splitting it
+// into pieces of at least 256 KiB; 0 or 1 for the calling thread alone
+// (default)
+#define MYHEAP_OPT_WALK_THREADS    18
+
+// when non-zero the payloads of blocks allocated by different threads
+// never share a 64-byte cache line, while blocks of one thread still do;
+// myInit then leaves MYHEAP_OPT_CPUCACHE, MYHEAP_OPT_MAGAZINES and
+// MYHEAP_OPT_LOCKFREE off, which pass blocks between threads
+#define MYHEAP_OPT_ISOLATE         19
+
+int   myOpt(int param, long value);
+int   myHeapOpt(myHeap *heap, int param, long value);
+
+/*
+ * Allocator counters, read with myStat().
+ */
+
+// myAlloc calls that merged and retried, and how many of those succeeded
+#define MYHEAP_STAT_RETRIES        1
+#define MYHEAP_STAT_RETRY_HITS     2
+
+// bytes currently mapped for the heap, and how often it grew
+#define MYHEAP_STAT_HEAP_SIZE      3
+#define MYHEAP_STAT_GROWS          4
+
+// pages given back to the OS, and purged pages handed out again
+#define MYHEAP_STAT_PURGED_PAGES   5
+#define MYHEAP_STAT_REFAULTED_PAGES 6
+
+// MYHEAP_HUGE_* backing in use, and the page size the heap works in
+#define MYHEAP_STAT_HUGEPAGES      7
+#define MYHEAP_STAT_PAGE_SIZE      8
+
+// number of arenas, with MYHEAP_OPT_ARENAS the other counters read by
+// myStat() are those of the calling thread's arena
+#define MYHEAP_STAT_ARENAS         9
+
+// 1 if MYHEAP_OPT_CPUCACHE got per-CPU caches, 0 otherwise
+#define MYHEAP_STAT_CPUCACHE       10
+
+// largest size of the magazines handed out now
+#define MYHEAP_STAT_MAGAZINE_SIZE  11
+
+// number of shards, with MYHEAP_OPT_SHARDS the other counters read by
+// myStat() are those of the first shard
+#define MYHEAP_STAT_SHARDS         12
+
+// blocks the calling thread's arena got from other arenas, see
+// MYHEAP_OPT_STEAL
+#define MYHEAP_STAT_STEALS         13
+
+// bytes in allocated and in free blocks and the size of the largest free
+// block, found by walking the heap; blocks held by the caches count as
+// allocated
+#define MYHEAP_STAT_USED_SIZE      14
+#define MYHEAP_STAT_FREE_SIZE      15
+#define MYHEAP_STAT_LARGEST_FREE   16
+
+// blocks MYHEAP_OPT_ISOLATE moved to a cache line of their own, leaving a
+// free block in front of them
+#define MYHEAP_STAT_ISOLATE_MOVES  17
+
+// what merging and retrying did in the calling thread's last myAlloc or
+// myHeapAlloc, one of MYHEAP_RETRY_*
+#define MYHEAP_STAT_LAST_RETRY     18
+#define MYHEAP_RETRY_NONE          0   // no merge was tried
+#define MYHEAP_RETRY_MISS          1   // merged, but no block fitted
+#define MYHEAP_RETRY_HIT           2   // merged, and a block fitted
+
+long  myStat(int stat);
+long  myHeapStat(myHeap *heap, int stat);
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ * A block freed into another thread's arena must not be accepted a second
+ * time, neither while it waits in the arena's remote list nor once
+ * coalesce() has freed it into an arena whose owner has exited.
+ */
+#include <stdio.h>
+#include <pthread.h>
+#include "myHeap.h"
+
+#define BLOCKS 100
+
+static void *blocks[BLOCKS];
+
+static void* allocSome(void *unused) {
+    (void)unused;
+    for (int i = 0; i < BLOCKS; i++) {
+        blocks[i] = myAlloc(24 + i % 4 * 8);
+    }
+    return NULL;
+}
+
+int main() {
+    myOpt(MYHEAP_OPT_ARENAS, 1);
+    if (myInit(1 << 20) != 0) {
+        fprintf(stderr, "arenaRemoteFree: myInit failed\n");
+        return 1;
+    }
+    // the default heap becomes this thread's arena, the worker gets another
+    void *own = myAlloc(8);
+
+    pthread_t worker;
+    pthread_create(&worker, NULL, allocSome, NULL);
+    pthread_join(worker, NULL);
+
+    for (int i = 0; i < BLOCKS; i++) {
+        if (blocks[i] == NULL || myFree(blocks[i]) != 0) {
+            fprintf(stderr, "arenaRemoteFree: remote free failed\n");
+            return 1;
+        }
+        if (myFree(blocks[i]) != -1) {
+            fprintf(stderr, "arenaRemoteFree: double free into the remote list accepted\n");
+            return 1;
+        }
+    }
+    coalesce();
+    for (int i = 0; i < BLOCKS; i++) {
+        if (myFree(blocks[i]) != -1) {
+            fprintf(stderr, "arenaRemoteFree: double free after coalesce accepted\n");
+            return 1;
+        }
+    }
+    myFree(own);
+    printf("arenaRemoteFree: ok\n");
+    return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * With MYHEAP_OPT_STEAL a thread whose arena is full must allocate from
+ * the free blocks of another arena before growing its own, never grow
+ * the other arena, and hand the stolen blocks back to it when it frees
+ * them.
+ */
+#include <stdio.h>
+#include <pthread.h>
+#include "myHeap.h"
+
+#define REGION (1 << 20)
+#define BLOCK 1000
+#define BLOCKS (3 * REGION / 2 / BLOCK)
+
+static void *blocks[BLOCKS];
+static long steals;
+static long grows;
+
+static void* allocMany(void *unused) {
+    (void)unused;
+    for (int i = 0; i < BLOCKS; i++) {
+        blocks[i] = myAlloc(BLOCK);
+    }
+    steals = myStat(MYHEAP_STAT_STEALS);
+    grows = myStat(MYHEAP_STAT_GROWS);
+    for (int i = 0; i < BLOCKS; i++) {
+        myFree(blocks[i]);
+    }
+    return NULL;
+}
+
+int main() {
+    myOpt(MYHEAP_OPT_ARENAS, 1);
+    myOpt(MYHEAP_OPT_STEAL, 1);
+    myOpt(MYHEAP_OPT_MAX_SIZE, 4 * REGION);
+    if (myInit(REGION) != 0) {
+        fprintf(stderr, "arenaSteal: myInit failed\n");
+        return 1;
+    }
+    // the default heap becomes this thread's arena and stays almost empty
+    void *own = myAlloc(8);
+
+    pthread_t worker;
+    pthread_create(&worker, NULL, allocMany, NULL);
+    pthread_join(worker, NULL);
+
+    for (int i = 0; i < BLOCKS; i++) {
+        if (blocks[i] == NULL) {
+            fprintf(stderr, "arenaSteal: myAlloc failed with room in another arena\n");
+            return 1;
+        }
+    }
+    if (steals == 0) {
+        fprintf(stderr, "arenaSteal: nothing stolen\n");
+        return 1;
+    }
+    if (grows != 0 || myStat(MYHEAP_STAT_GROWS) != 0) {
+        fprintf(stderr, "arenaSteal: an arena grew while another had room\n");
+        return 1;
+    }
+
+    // the stolen blocks came back through the remote list
+    myFree(own);
+    coalesce();
+    if (myStat(MYHEAP_STAT_USED_SIZE) != 0) {
+        fprintf(stderr, "arenaSteal: stolen blocks not handed back\n");
+        return 1;
+    }
+    printf("arenaSteal: ok\n");
+    return 0;
+}
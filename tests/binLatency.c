@@ -0,0 +1,69 @@
+/*
+ * myFree and myAlloc with the bins engine must not slow down with the
+ * number of free blocks of one size.  Freeing every other one of many
+ * equal blocks puts them all in one place of the free block index, which
+ * a sorted list has to walk on every insert.
+ */
+#include <stdio.h>
+#include <time.h>
+#include "myHeap.h"
+
+#define BLOCKS 60000
+#define BLOCK_SIZE 1000
+// a list walk takes hundreds of microseconds per call here
+#define LIMIT_NS 10000
+
+static long nowNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+static void *blocks[BLOCKS];
+
+static int run(int coalesceMode) {
+    myOpt(MYHEAP_OPT_ENGINE, MYHEAP_ENGINE_BINS);
+    myOpt(MYHEAP_OPT_COALESCE, coalesceMode);
+    myHeap *h = myHeapCreate((BLOCKS + 1) * (BLOCK_SIZE + 16));
+    if (h == NULL) {
+        fprintf(stderr, "binLatency: myHeapCreate failed\n");
+        return 1;
+    }
+    for (int i = 0; i < BLOCKS; i++) {
+        blocks[i] = myHeapAlloc(h, BLOCK_SIZE);
+        if (blocks[i] == NULL) {
+            fprintf(stderr, "binLatency: myHeapAlloc failed\n");
+            return 1;
+        }
+    }
+
+    long start = nowNs();
+    for (int i = 0; i < BLOCKS; i += 2) {
+        myHeapFree(h, blocks[i]);
+    }
+    long freeNs = (nowNs() - start) / (BLOCKS / 2);
+
+    start = nowNs();
+    for (int i = 0; i < BLOCKS; i += 2) {
+        blocks[i] = myHeapAlloc(h, BLOCK_SIZE);
+    }
+    long allocNs = (nowNs() - start) / (BLOCKS / 2);
+
+    myHeapDestroy(h);
+    if (freeNs > LIMIT_NS || allocNs > LIMIT_NS) {
+        fprintf(stderr, "binLatency: %ld ns per free, %ld ns per alloc (mode %d)\n",
+                freeNs, allocNs, coalesceMode);
+        return 1;
+    }
+    return 0;
+}
+
+int main() {
+    int failed = run(MYHEAP_COALESCE_DELAYED);
+    failed |= run(MYHEAP_COALESCE_IMMEDIATE);
+    failed |= run(MYHEAP_COALESCE_INCREMENTAL);
+    if (!failed) {
+        printf("binLatency: ok\n");
+    }
+    return failed;
+}
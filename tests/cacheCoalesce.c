@@ -0,0 +1,44 @@
+/*
+ * coalesce() must leave nothing used once the caller has freed all its
+ * blocks, also those still sitting in the caller's own cache or on the
+ * shared lock-free stacks in front of the default heap.
+ */
+#include <stdio.h>
+#include "myHeap.h"
+#include "check.h"
+
+#define BLOCKS 1000
+
+static int run(long option) {
+    myOpt(option, 32);
+    if (myInit(1 << 20) != 0) {
+        fprintf(stderr, "cacheCoalesce: myInit failed\n");
+        return 1;
+    }
+    void *blocks[BLOCKS];
+    for (int i = 0; i < BLOCKS; i++) {
+        blocks[i] = myAlloc(8 + i % 500);
+    }
+    for (int i = 0; i < BLOCKS; i++) {
+        myFree(blocks[i]);
+    }
+    coalesce();
+    long used = myStat(MYHEAP_STAT_USED_SIZE);
+    if (used != 0) {
+        fprintf(stderr, "cacheCoalesce: %ld bytes still used (option %ld)\n", used, option);
+        return 1;
+    }
+    return 0;
+}
+
+int main() {
+    long options[] = { MYHEAP_OPT_TCACHE, MYHEAP_OPT_MAGAZINES, MYHEAP_OPT_LOCKFREE };
+    int failed = 0;
+    for (unsigned int i = 0; i < sizeof(options) / sizeof(options[0]); i++) {
+        failed |= runChild(run, options[i]);
+    }
+    if (!failed) {
+        printf("cacheCoalesce: ok\n");
+    }
+    return failed;
+}
@@ -0,0 +1,68 @@
+/*
+ * Freeing a block twice must fail while the block sits in one of the
+ * caches in front of the default heap, also once the cache is full, and
+ * a block handed out again by the cache must still be freed normally.
+ */
+#include <stdio.h>
+#include "myHeap.h"
+#include "check.h"
+
+#define FILL 100
+
+static int run(long option) {
+    myOpt(option, 32);
+    if (myInit(1 << 20) != 0) {
+        fprintf(stderr, "cacheDoubleFree: myInit failed\n");
+        return 1;
+    }
+    for (int round = 0; round < 100; round++) {
+        void *ptr = myAlloc(40);
+        if (ptr == NULL || myFree(ptr) != 0) {
+            fprintf(stderr, "cacheDoubleFree: free failed (option %ld)\n", option);
+            return 1;
+        }
+        if (myFree(ptr) != -1) {
+            fprintf(stderr, "cacheDoubleFree: double free accepted (option %ld)\n", option);
+            return 1;
+        }
+    }
+
+    // more blocks than a cache holds, so the first ones sit in a full one
+    void *blocks[FILL];
+    for (int i = 0; i < FILL; i++) {
+        blocks[i] = myAlloc(24);
+    }
+    for (int i = 0; i < FILL; i++) {
+        myFree(blocks[i]);
+    }
+    for (int i = 0; i < FILL; i++) {
+        if (myFree(blocks[i]) != -1) {
+            fprintf(stderr, "cacheDoubleFree: double free into a full cache accepted "
+                    "(option %ld)\n", option);
+            return 1;
+        }
+    }
+    for (int i = 0; i < FILL; i++) {
+        blocks[i] = myAlloc(24);
+        for (int j = 0; j < i; j++) {
+            if (blocks[j] == blocks[i]) {
+                fprintf(stderr, "cacheDoubleFree: block handed out twice (option %ld)\n", option);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main() {
+    long options[] = { MYHEAP_OPT_TCACHE, MYHEAP_OPT_CPUCACHE, MYHEAP_OPT_MAGAZINES,
+                       MYHEAP_OPT_LOCKFREE };
+    int failed = 0;
+    for (unsigned int i = 0; i < sizeof(options) / sizeof(options[0]); i++) {
+        failed |= runChild(run, options[i]);
+    }
+    if (!failed) {
+        printf("cacheDoubleFree: ok\n");
+    }
+    return failed;
+}
@@ -0,0 +1,29 @@
+/*
+ * Helpers shared by the checks.  The options of the default heap are
+ * fixed by the one myInit call a process makes, so a check that tries
+ * several of them runs each in a child process of its own.
+ */
+#ifndef __check_h
+#define __check_h
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// runs 'check' with 'arg' in a child process, returns its exit status
+static inline int runChild(int (*check)(long), long arg) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int result = check(arg);
+        fflush(stdout);
+        _exit(result);
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+        return 1;
+    }
+    return WEXITSTATUS(status);
+}
+
+#endif
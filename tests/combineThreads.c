@@ -0,0 +1,78 @@
+/*
+ * With MYHEAP_OPT_COMBINING calls run by another thread must hand every
+ * caller a block of its own and free the caller's blocks, so that blocks
+ * never overlap and the heap merges back into one block at the end.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "myHeap.h"
+
+#define REGION (4 << 20)
+#define THREADS 8
+#define ROUNDS 2000
+#define HELD 32
+// every slot of a thread holds blocks of one size
+#define SIZE(slot) (16 + (slot) * 24)
+
+static myHeap *shared;
+static int failed;
+
+static void* churn(void *arg) {
+    int id = (int)(long)arg;
+    char *held[HELD] = { NULL };
+    for (int round = 0; round < ROUNDS; round++) {
+        int slot = round % HELD;
+        if (held[slot] != NULL) {
+            for (int i = 0; i < SIZE(slot); i++) {
+                if (held[slot][i] != id) {
+                    __atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+                }
+            }
+            if (myHeapFree(shared, held[slot]) != 0) {
+                __atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+            }
+        }
+        held[slot] = myHeapAlloc(shared, SIZE(slot));
+        if (held[slot] == NULL) {
+            __atomic_store_n(&failed, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+        memset(held[slot], id, SIZE(slot));
+    }
+    for (int slot = 0; slot < HELD; slot++) {
+        myHeapFree(shared, held[slot]);
+    }
+    return NULL;
+}
+
+int main() {
+    myOpt(MYHEAP_OPT_COMBINING, 1);
+    myOpt(MYHEAP_OPT_COALESCE, MYHEAP_COALESCE_IMMEDIATE);
+    shared = myHeapCreate(REGION);
+    if (shared == NULL) {
+        fprintf(stderr, "combineThreads: myHeapCreate failed\n");
+        return 1;
+    }
+
+    pthread_t workers[THREADS];
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&workers[t], NULL, churn, (void*)(long)(t + 1));
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(workers[t], NULL);
+    }
+    if (failed) {
+        fprintf(stderr, "combineThreads: block lost, shared or not freed\n");
+        return 1;
+    }
+
+    if (myHeapStat(shared, MYHEAP_STAT_LARGEST_FREE) != myHeapStat(shared, MYHEAP_STAT_FREE_SIZE)
+            || myHeapAlloc(shared, REGION - 4096) == NULL) {
+        fprintf(stderr, "combineThreads: heap not merged\n");
+        return 1;
+    }
+    myHeapDestroy(shared);
+    printf("combineThreads: ok\n");
+    return 0;
+}
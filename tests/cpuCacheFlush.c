@@ -0,0 +1,58 @@
+/*
+ * Blocks left in the per-CPU caches must be given back to the heap by
+ * coalesce(), whichever CPUs the threads that freed them ran on, and
+ * without moving the calling thread to other CPUs.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <sched.h>
+#include <pthread.h>
+#include "myHeap.h"
+
+#define THREADS 4
+#define BLOCKS 1000
+
+static void* allocSome(void *unused) {
+    (void)unused;
+    void *blocks[BLOCKS];
+    for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < BLOCKS; i++) {
+            blocks[i] = myAlloc(8 + i % 200);
+        }
+        for (int i = 0; i < BLOCKS; i++) {
+            myFree(blocks[i]);
+        }
+    }
+    return NULL;
+}
+
+int main() {
+    myOpt(MYHEAP_OPT_CPUCACHE, 32);
+    if (myInit(4 << 20) != 0) {
+        fprintf(stderr, "cpuCacheFlush: myInit failed\n");
+        return 1;
+    }
+    pthread_t workers[THREADS];
+    for (int i = 0; i < THREADS; i++) {
+        pthread_create(&workers[i], NULL, allocSome, NULL);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    cpu_set_t before, after;
+    sched_getaffinity(0, sizeof(before), &before);
+    coalesce();
+    sched_getaffinity(0, sizeof(after), &after);
+    if (!CPU_EQUAL(&before, &after)) {
+        fprintf(stderr, "cpuCacheFlush: coalesce() changed the CPU affinity\n");
+        return 1;
+    }
+    long used = myStat(MYHEAP_STAT_USED_SIZE);
+    if (used != 0) {
+        fprintf(stderr, "cpuCacheFlush: %ld bytes still used\n", used);
+        return 1;
+    }
+    printf("cpuCacheFlush: ok\n");
+    return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * myFree must not write the header of the block after the one freed, which
+ * belongs to whichever thread owns that block, yet the heap must still
+ * merge the freed block once that next block is freed too.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "myHeap.h"
+
+#define REGION (64 * 1024)
+#define BLOCKS 64
+// headers are as wide as the sizes passed in
+#define HEADER sizeof(myHeapSize)
+
+static void *blocks[BLOCKS];
+
+static int run(int coalesceMode) {
+    myOpt(MYHEAP_OPT_COALESCE, coalesceMode);
+    myHeap *h = myHeapCreate(REGION);
+    if (h == NULL) {
+        fprintf(stderr, "freeNextHeader: myHeapCreate failed\n");
+        return 1;
+    }
+    for (int i = 0; i < BLOCKS; i++) {
+        blocks[i] = myHeapAlloc(h, 40 + i * 8);
+        if (blocks[i] == NULL) {
+            fprintf(stderr, "freeNextHeader: myHeapAlloc failed\n");
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < BLOCKS - 1; i += 2) {
+        char before[HEADER];
+        char *next = (char*)blocks[i + 1] - HEADER;
+        memcpy(before, next, HEADER);
+        if (myHeapFree(h, blocks[i]) != 0) {
+            fprintf(stderr, "freeNextHeader: myHeapFree failed (mode %d)\n", coalesceMode);
+            return 1;
+        }
+        if (memcmp(before, next, HEADER) != 0) {
+            fprintf(stderr, "freeNextHeader: next header written (mode %d)\n", coalesceMode);
+            return 1;
+        }
+    }
+
+    for (int i = 1; i < BLOCKS; i += 2) {
+        if (myHeapFree(h, blocks[i]) != 0 || myHeapFree(h, blocks[i]) != -1) {
+            fprintf(stderr, "freeNextHeader: myHeapFree failed or accepted a double free\n");
+            return 1;
+        }
+    }
+    myHeapCoalesce(h);
+    if (myHeapAlloc(h, REGION - 4096) == NULL) {
+        fprintf(stderr, "freeNextHeader: heap not merged (mode %d)\n", coalesceMode);
+        return 1;
+    }
+    myHeapDestroy(h);
+    return 0;
+}
+
+int main() {
+    int failed = run(MYHEAP_COALESCE_DELAYED);
+    failed |= run(MYHEAP_COALESCE_IMMEDIATE);
+    failed |= run(MYHEAP_COALESCE_INCREMENTAL);
+    if (!failed) {
+        printf("freeNextHeader: ok\n");
+    }
+    return failed;
+}
@@ -0,0 +1,54 @@
+/*
+ * With MYHEAP_OPT_MAX_SIZE myAlloc must grow the heap instead of failing,
+ * never past the maximum, and the grown part must merge with the rest of
+ * the heap once everything is freed.
+ */
+#include <stdio.h>
+#include "myHeap.h"
+
+#define REGION (256 * 1024)
+#define MAX_SIZE (4 * REGION)
+#define BLOCK 1000
+#define BLOCKS (2 * MAX_SIZE / BLOCK)
+
+static void *blocks[BLOCKS];
+
+int main() {
+    myOpt(MYHEAP_OPT_MAX_SIZE, MAX_SIZE);
+    myHeap *h = myHeapCreate(REGION);
+    if (h == NULL) {
+        fprintf(stderr, "growToMax: myHeapCreate failed\n");
+        return 1;
+    }
+
+    int count = 0;
+    while (count < BLOCKS && (blocks[count] = myHeapAlloc(h, BLOCK)) != NULL) {
+        count++;
+    }
+    long size = myHeapStat(h, MYHEAP_STAT_HEAP_SIZE);
+    if (myHeapStat(h, MYHEAP_STAT_GROWS) == 0 || size > MAX_SIZE) {
+        fprintf(stderr, "growToMax: grown %ld times to %ld bytes\n",
+                myHeapStat(h, MYHEAP_STAT_GROWS), size);
+        return 1;
+    }
+    // a full heap leaves less than a page unused
+    if ((long)count * (BLOCK + 8) < MAX_SIZE - 4096 - BLOCK) {
+        fprintf(stderr, "growToMax: only %d blocks before running out\n", count);
+        return 1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (myHeapFree(h, blocks[i]) != 0 || myHeapFree(h, blocks[i]) != -1) {
+            fprintf(stderr, "growToMax: myHeapFree failed or accepted a double free\n");
+            return 1;
+        }
+    }
+    myHeapCoalesce(h);
+    if (myHeapAlloc(h, MAX_SIZE - 8192) == NULL) {
+        fprintf(stderr, "growToMax: the grown part did not merge with the rest\n");
+        return 1;
+    }
+    myHeapDestroy(h);
+    printf("growToMax: ok\n");
+    return 0;
+}
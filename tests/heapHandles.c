@@ -0,0 +1,83 @@
+/*
+ * Heaps made by myHeapCreate must be independent of each other and of the
+ * default heap: a block is only freed into the heap it came from, each
+ * heap coalesces on its own, and destroying one leaves the others usable.
+ */
+#include <stdio.h>
+#include "myHeap.h"
+
+#define REGION (64 * 1024)
+#define BLOCKS 100
+
+int main() {
+    if (myInit(REGION) != 0) {
+        fprintf(stderr, "heapHandles: myInit failed\n");
+        return 1;
+    }
+    myHeap *first = myHeapCreate(REGION);
+    myOpt(MYHEAP_OPT_ENGINE, MYHEAP_ENGINE_TREE);
+    myHeap *second = myHeapCreate(REGION);
+    if (first == NULL || second == NULL || first == second) {
+        fprintf(stderr, "heapHandles: myHeapCreate failed\n");
+        return 1;
+    }
+
+    void *a[BLOCKS];
+    void *b[BLOCKS];
+    for (int i = 0; i < BLOCKS; i++) {
+        a[i] = myHeapAlloc(first, 200);
+        b[i] = myHeapAlloc(second, 200);
+        if (a[i] == NULL || b[i] == NULL) {
+            fprintf(stderr, "heapHandles: myHeapAlloc failed\n");
+            return 1;
+        }
+    }
+    void *mine = myAlloc(200);
+
+    // no heap takes another heap's blocks
+    if (myHeapFree(second, a[0]) != -1 || myHeapFree(first, b[0]) != -1
+            || myFree(a[0]) != -1 || myHeapFree(first, mine) != -1) {
+        fprintf(stderr, "heapHandles: block freed into the wrong heap\n");
+        return 1;
+    }
+    if (myHeapAlloc(NULL, 8) != NULL || myHeapFree(NULL, a[0]) != -1
+            || myHeapCoalesce(NULL) != -1 || myHeapDestroy(NULL) != -1) {
+        fprintf(stderr, "heapHandles: NULL heap accepted\n");
+        return 1;
+    }
+
+    for (int i = 0; i < BLOCKS; i++) {
+        if (myHeapFree(first, a[i]) != 0 || myHeapFree(first, a[i]) != -1) {
+            fprintf(stderr, "heapHandles: myHeapFree failed or accepted a double free\n");
+            return 1;
+        }
+    }
+    myHeapCoalesce(first);
+    if (myHeapStat(first, MYHEAP_STAT_LARGEST_FREE) != myHeapStat(first, MYHEAP_STAT_FREE_SIZE)) {
+        fprintf(stderr, "heapHandles: first heap not merged\n");
+        return 1;
+    }
+    if (myHeapStat(second, MYHEAP_STAT_FREE_SIZE) >= REGION - BLOCKS * 200) {
+        fprintf(stderr, "heapHandles: second heap changed by the first\n");
+        return 1;
+    }
+
+    if (myHeapDestroy(first) != 0) {
+        fprintf(stderr, "heapHandles: myHeapDestroy failed\n");
+        return 1;
+    }
+    for (int i = 0; i < BLOCKS; i++) {
+        if (myHeapFree(second, b[i]) != 0) {
+            fprintf(stderr, "heapHandles: second heap broken by destroying the first\n");
+            return 1;
+        }
+    }
+    myHeapCoalesce(second);
+    if (myHeapAlloc(second, REGION - 4096) == NULL || myFree(mine) != 0) {
+        fprintf(stderr, "heapHandles: second or default heap broken\n");
+        return 1;
+    }
+    myHeapDestroy(second);
+    printf("heapHandles: ok\n");
+    return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * MYHEAP_OPT_HUGEPAGES must give a working heap whether or not huge pages
+ * are available here: the heap reports the backing it got and the page
+ * size that goes with it, large blocks come off its end when huge pages
+ * are in use, and everything freed merges back into one block.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include "myHeap.h"
+
+#define REGION (4 << 20)
+#define HUGE_PAGE (2 << 20)
+#define SMALL 100
+#define LARGE (128 * 1024)
+#define BLOCKS 16
+
+static int run(int mode) {
+    myOpt(MYHEAP_OPT_HUGEPAGES, mode);
+    myHeap *h = myHeapCreate(REGION);
+    if (h == NULL) {
+        fprintf(stderr, "hugeFallback: myHeapCreate failed (mode %d)\n", mode);
+        return 1;
+    }
+
+    // the hugetlb pool is only used when asked for
+    long active = myHeapStat(h, MYHEAP_STAT_HUGEPAGES);
+    long page = myHeapStat(h, MYHEAP_STAT_PAGE_SIZE);
+    if (active < MYHEAP_HUGE_OFF || active > mode) {
+        fprintf(stderr, "hugeFallback: backing %ld for mode %d\n", active, mode);
+        return 1;
+    }
+    if (page != (active == MYHEAP_HUGE_OFF ? getpagesize() : HUGE_PAGE)
+            || myHeapStat(h, MYHEAP_STAT_HEAP_SIZE) % page != 0) {
+        fprintf(stderr, "hugeFallback: page size %ld with backing %ld\n", page, active);
+        return 1;
+    }
+
+    void *small[BLOCKS];
+    void *large[BLOCKS / 4];
+    for (int i = 0; i < BLOCKS; i++) {
+        small[i] = myHeapAlloc(h, SMALL);
+        if (i % 4 == 0) {
+            large[i / 4] = myHeapAlloc(h, LARGE);
+        }
+        if (small[i] == NULL || (i % 4 == 0 && large[i / 4] == NULL)) {
+            fprintf(stderr, "hugeFallback: myHeapAlloc failed (backing %ld)\n", active);
+            return 1;
+        }
+    }
+    // small blocks stay packed together in front of the large ones
+    if (active != MYHEAP_HUGE_OFF
+            && (char*)small[BLOCKS - 1] - (char*)small[0] >= LARGE) {
+        fprintf(stderr, "hugeFallback: large blocks placed between small ones\n");
+        return 1;
+    }
+
+    for (int i = 0; i < BLOCKS; i++) {
+        if (myHeapFree(h, small[i]) != 0 || myHeapFree(h, small[i]) != -1) {
+            fprintf(stderr, "hugeFallback: myHeapFree failed or accepted a double free\n");
+            return 1;
+        }
+    }
+    for (int i = 0; i < BLOCKS / 4; i++) {
+        if (myHeapFree(h, large[i]) != 0) {
+            fprintf(stderr, "hugeFallback: myHeapFree of a large block failed\n");
+            return 1;
+        }
+    }
+    myHeapCoalesce(h);
+    if (myHeapAlloc(h, REGION - 4096) == NULL) {
+        fprintf(stderr, "hugeFallback: heap not merged (backing %ld)\n", active);
+        return 1;
+    }
+    myHeapDestroy(h);
+    return 0;
+}
+
+int main() {
+    int failed = run(MYHEAP_HUGE_THP);
+    failed |= run(MYHEAP_HUGE_HUGETLB);
+    if (!failed) {
+        printf("hugeFallback: ok\n");
+    }
+    return failed;
+}
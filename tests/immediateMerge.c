@@ -0,0 +1,63 @@
+/*
+ * With immediate coalescing myFree merges a block with its free neighbours
+ * at once, so the heap is one free block again without coalesce(), and a
+ * block absorbed by a neighbour must still not be freed twice.
+ */
+#include <stdio.h>
+#include "myHeap.h"
+
+#define REGION (512 * 1024)
+#define BLOCKS 1000
+
+static void *blocks[BLOCKS];
+
+static int run(int engine) {
+    myOpt(MYHEAP_OPT_ENGINE, engine);
+    myOpt(MYHEAP_OPT_COALESCE, MYHEAP_COALESCE_IMMEDIATE);
+    myHeap *h = myHeapCreate(REGION);
+    if (h == NULL) {
+        fprintf(stderr, "immediateMerge: myHeapCreate failed\n");
+        return 1;
+    }
+    for (int i = 0; i < BLOCKS; i++) {
+        blocks[i] = myHeapAlloc(h, 8 + (i * 53) % 600);
+        if (blocks[i] == NULL) {
+            fprintf(stderr, "immediateMerge: myHeapAlloc failed (engine %d)\n", engine);
+            return 1;
+        }
+    }
+
+    // the second pass frees blocks between two free ones
+    for (int start = 0; start < 2; start++) {
+        for (int i = start; i < BLOCKS; i += 2) {
+            if (myHeapFree(h, blocks[i]) != 0) {
+                fprintf(stderr, "immediateMerge: myHeapFree failed (engine %d)\n", engine);
+                return 1;
+            }
+        }
+    }
+    for (int i = 0; i < BLOCKS; i++) {
+        if (myHeapFree(h, blocks[i]) != -1) {
+            fprintf(stderr, "immediateMerge: merged block %d freed again (engine %d)\n",
+                    i, engine);
+            return 1;
+        }
+    }
+
+    if (myHeapStat(h, MYHEAP_STAT_LARGEST_FREE) != myHeapStat(h, MYHEAP_STAT_FREE_SIZE)
+            || myHeapAlloc(h, REGION - 4096) == NULL) {
+        fprintf(stderr, "immediateMerge: heap not merged by myFree (engine %d)\n", engine);
+        return 1;
+    }
+    myHeapDestroy(h);
+    return 0;
+}
+
+int main() {
+    int failed = run(MYHEAP_ENGINE_BINS);
+    failed |= run(MYHEAP_ENGINE_TREE);
+    if (!failed) {
+        printf("immediateMerge: ok\n");
+    }
+    return failed;
+}
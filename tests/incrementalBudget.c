@@ -0,0 +1,67 @@
+/*
+ * With incremental coalescing coalesce() must merge no more queued blocks
+ * per call than MYHEAP_OPT_COALESCE_BUDGET allows, all of them with a
+ * budget of 0 set on the live heap, and merged blocks must still not be
+ * freed twice.
+ */
+#include <stdio.h>
+#include "myHeap.h"
+
+// few enough blocks to all wait in the queue
+#define REGION (16 * 1024)
+#define BLOCK 64
+#define BLOCKS (REGION / BLOCK)
+#define BUDGET 8
+
+static void *blocks[BLOCKS];
+
+int main() {
+    myOpt(MYHEAP_OPT_COALESCE, MYHEAP_COALESCE_INCREMENTAL);
+    myOpt(MYHEAP_OPT_COALESCE_BUDGET, BUDGET);
+    myHeap *h = myHeapCreate(REGION);
+    if (h == NULL) {
+        fprintf(stderr, "incrementalBudget: myHeapCreate failed\n");
+        return 1;
+    }
+
+    // fills the heap, so no free block is left after the last one
+    int count = 0;
+    while (count < BLOCKS && (blocks[count] = myHeapAlloc(h, BLOCK)) != NULL) {
+        count++;
+    }
+    for (int i = 0; i < count; i++) {
+        if (myHeapFree(h, blocks[i]) != 0) {
+            fprintf(stderr, "incrementalBudget: myHeapFree failed\n");
+            return 1;
+        }
+    }
+
+    // each queued block merges with at most its two neighbours
+    myHeapCoalesce(h);
+    long largest = myHeapStat(h, MYHEAP_STAT_LARGEST_FREE);
+    if (largest > 3 * BUDGET * (BLOCK + 16) || largest == myHeapStat(h, MYHEAP_STAT_FREE_SIZE)) {
+        fprintf(stderr, "incrementalBudget: %ld bytes merged by one call with budget %d\n",
+                largest, BUDGET);
+        return 1;
+    }
+
+    myHeapOpt(h, MYHEAP_OPT_COALESCE_BUDGET, 0);
+    myHeapCoalesce(h);
+    if (myHeapStat(h, MYHEAP_STAT_LARGEST_FREE) != myHeapStat(h, MYHEAP_STAT_FREE_SIZE)) {
+        fprintf(stderr, "incrementalBudget: queue not emptied without a budget\n");
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (myHeapFree(h, blocks[i]) != -1) {
+            fprintf(stderr, "incrementalBudget: merged block %d freed again\n", i);
+            return 1;
+        }
+    }
+    if (myHeapAlloc(h, REGION - 4096) == NULL) {
+        fprintf(stderr, "incrementalBudget: the merged block is not found\n");
+        return 1;
+    }
+    myHeapDestroy(h);
+    printf("incrementalBudget: ok\n");
+    return 0;
+}
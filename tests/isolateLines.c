@@ -0,0 +1,94 @@
+/*
+ * With MYHEAP_OPT_ISOLATE the payloads of blocks allocated by different
+ * threads must never share a 64-byte cache line, also after lines were
+ * freed and handed out again, and the blocks moved to lines of their own
+ * must still be freed and merged like any other.
+ */
+#include <stdio.h>
+#include <pthread.h>
+#include "myHeap.h"
+
+#define REGION (4 << 20)
+#define LINE 64
+#define THREADS 4
+#define BLOCKS 400
+
+static myHeap *shared;
+static pthread_barrier_t start;
+static char *blocks[THREADS][BLOCKS];
+
+static int sizeOf(int i) {
+    return 8 + (i * 13) % 150;
+}
+
+static void* allocSome(void *arg) {
+    char **mine = arg;
+    pthread_barrier_wait(&start);
+    for (int i = 0; i < BLOCKS; i++) {
+        mine[i] = myHeapAlloc(shared, sizeOf(i));
+    }
+    // the freed lines go back to whichever thread asks next
+    for (int i = 0; i < BLOCKS; i += 2) {
+        myHeapFree(shared, mine[i]);
+    }
+    for (int i = 0; i < BLOCKS; i += 2) {
+        mine[i] = myHeapAlloc(shared, sizeOf(i));
+    }
+    return NULL;
+}
+
+int main() {
+    myOpt(MYHEAP_OPT_ISOLATE, 1);
+    myOpt(MYHEAP_OPT_COALESCE, MYHEAP_COALESCE_IMMEDIATE);
+    shared = myHeapCreate(REGION);
+    if (shared == NULL) {
+        fprintf(stderr, "isolateLines: myHeapCreate failed\n");
+        return 1;
+    }
+
+    pthread_barrier_init(&start, NULL, THREADS);
+    pthread_t workers[THREADS];
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&workers[t], NULL, allocSome, blocks[t]);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(workers[t], NULL);
+    }
+
+    for (int t = 0; t < THREADS; t++) {
+        for (int i = 0; i < BLOCKS; i++) {
+            if (blocks[t][i] == NULL) {
+                fprintf(stderr, "isolateLines: myHeapAlloc failed\n");
+                return 1;
+            }
+            unsigned long first = (unsigned long)blocks[t][i] / LINE;
+            unsigned long last = (unsigned long)(blocks[t][i] + sizeOf(i) - 1) / LINE;
+            for (int u = t + 1; u < THREADS; u++) {
+                for (int j = 0; j < BLOCKS; j++) {
+                    unsigned long otherFirst = (unsigned long)blocks[u][j] / LINE;
+                    unsigned long otherLast = (unsigned long)(blocks[u][j] + sizeOf(j) - 1) / LINE;
+                    if (first <= otherLast && otherFirst <= last) {
+                        fprintf(stderr, "isolateLines: threads %d and %d share a line\n", t, u);
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+
+    for (int t = 0; t < THREADS; t++) {
+        for (int i = 0; i < BLOCKS; i++) {
+            if (myHeapFree(shared, blocks[t][i]) != 0 || myHeapFree(shared, blocks[t][i]) != -1) {
+                fprintf(stderr, "isolateLines: myHeapFree failed or accepted a double free\n");
+                return 1;
+            }
+        }
+    }
+    if (myHeapAlloc(shared, REGION - 4096) == NULL) {
+        fprintf(stderr, "isolateLines: heap not merged\n");
+        return 1;
+    }
+    myHeapDestroy(shared);
+    printf("isolateLines: ok\n");
+    return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * Built with MYHEAP_64BIT a heap and a single block may be larger than
+ * 2 GiB; with the default 4-byte headers such sizes must be refused
+ * instead of wrapping around.  Only the pages written are touched.
+ */
+#include <stdio.h>
+#include <limits.h>
+#include "myHeap.h"
+
+#define GIB (1L << 30)
+
+#ifdef MYHEAP_64BIT
+static int run() {
+    if (myOpt(MYHEAP_OPT_MAX_SIZE, 4 * GIB) != 0) {
+        fprintf(stderr, "largeHeap: MYHEAP_OPT_MAX_SIZE of 4 GiB refused\n");
+        return 1;
+    }
+    myOpt(MYHEAP_OPT_MAX_SIZE, 0);
+    myHeap *h = myHeapCreate(3 * GIB);
+    if (h == NULL) {
+        fprintf(stderr, "largeHeap: myHeapCreate of 3 GiB failed\n");
+        return 1;
+    }
+    char *large = myHeapAlloc(h, 5 * GIB / 2);
+    void *small = myHeapAlloc(h, 100);
+    if (large == NULL || small == NULL) {
+        fprintf(stderr, "largeHeap: myHeapAlloc above 2 GiB failed\n");
+        return 1;
+    }
+    large[0] = 1;
+    large[5 * GIB / 2 - 1] = 1;
+    if ((char*)small < large + 5 * GIB / 2) {
+        fprintf(stderr, "largeHeap: block placed inside the large one\n");
+        return 1;
+    }
+
+    if (myHeapFree(h, large) != 0 || myHeapFree(h, small) != 0
+            || myHeapFree(h, large) != -1) {
+        fprintf(stderr, "largeHeap: myHeapFree failed or accepted a double free\n");
+        return 1;
+    }
+    myHeapCoalesce(h);
+    if (myHeapStat(h, MYHEAP_STAT_LARGEST_FREE) < 3 * GIB - 4096
+            || myHeapAlloc(h, 3 * GIB - 4096) == NULL) {
+        fprintf(stderr, "largeHeap: heap not merged into one block\n");
+        return 1;
+    }
+    myHeapDestroy(h);
+    return 0;
+}
+#else
+static int run() {
+    if (myOpt(MYHEAP_OPT_MAX_SIZE, 4 * GIB) != -1) {
+        fprintf(stderr, "largeHeap: MYHEAP_OPT_MAX_SIZE of 4 GiB accepted\n");
+        return 1;
+    }
+    myHeap *h = myHeapCreate(1 << 20);
+    if (h == NULL) {
+        fprintf(stderr, "largeHeap: myHeapCreate failed\n");
+        return 1;
+    }
+    if (myHeapAlloc(h, INT_MAX) != NULL || myHeapAlloc(h, -1) != NULL) {
+        fprintf(stderr, "largeHeap: block larger than the heap handed out\n");
+        return 1;
+    }
+    void *ptr = myHeapAlloc(h, 100);
+    if (ptr == NULL || myHeapFree(h, ptr) != 0) {
+        fprintf(stderr, "largeHeap: heap unusable after refusing a size\n");
+        return 1;
+    }
+    myHeapDestroy(h);
+    return 0;
+}
+#endif
+
+int main() {
+    int failed = run();
+    if (!failed) {
+        printf("largeHeap: ok\n");
+    }
+    return failed;
+}
@@ -0,0 +1,90 @@
+/*
+ * With MYHEAP_OPT_WALK_THREADS the heap walk is split among threads, which
+ * must give the same counters as a walk by the calling thread alone and
+ * coalesce the same runs, also those that cross from one piece into the
+ * next.
+ */
+#include <stdio.h>
+#include "myHeap.h"
+
+#define REGION (16 << 20)
+#define THREADS 4
+#define BLOCKS 4000
+
+static void *blocks[2][BLOCKS];
+
+static myHeap* build(int walkThreads, void **mine) {
+    myOpt(MYHEAP_OPT_WALK_THREADS, walkThreads);
+    myHeap *h = myHeapCreate(REGION);
+    if (h == NULL) {
+        return NULL;
+    }
+    // now and then a block larger than the pieces the walk is split into
+    for (int i = 0; i < BLOCKS; i++) {
+        mine[i] = myHeapAlloc(h, i % 500 == 0 ? 300 * 1024 : 8 + (i * 97) % 2000);
+    }
+    // runs of freed blocks of every length
+    for (int i = 0; i < BLOCKS; i++) {
+        if (i % 7 != 0 && i % 11 != 0) {
+            myHeapFree(h, mine[i]);
+        }
+    }
+    return h;
+}
+
+static int same(myHeap *one, myHeap *many, const char *when) {
+    int stats[] = { MYHEAP_STAT_USED_SIZE, MYHEAP_STAT_FREE_SIZE, MYHEAP_STAT_LARGEST_FREE };
+    for (unsigned int i = 0; i < sizeof(stats) / sizeof(stats[0]); i++) {
+        long alone = myHeapStat(one, stats[i]);
+        long split = myHeapStat(many, stats[i]);
+        if (alone != split) {
+            fprintf(stderr, "parallelWalk: counter %d is %ld instead of %ld %s\n",
+                    stats[i], split, alone, when);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main() {
+    myHeap *one = build(1, blocks[0]);
+    myHeap *many = build(THREADS, blocks[1]);
+    if (one == NULL || many == NULL) {
+        fprintf(stderr, "parallelWalk: myHeapCreate failed\n");
+        return 1;
+    }
+    for (int i = 0; i < BLOCKS; i++) {
+        if (blocks[0][i] == NULL || blocks[1][i] == NULL) {
+            fprintf(stderr, "parallelWalk: myHeapAlloc failed\n");
+            return 1;
+        }
+    }
+
+    if (same(one, many, "before coalescing")) {
+        return 1;
+    }
+    myHeapCoalesce(one);
+    myHeapCoalesce(many);
+    if (same(one, many, "after coalescing")) {
+        return 1;
+    }
+
+    // what is left merges into one block, and merged blocks are not freed twice
+    for (int i = 0; i < BLOCKS; i++) {
+        int freed = i % 7 != 0 && i % 11 != 0;
+        if (myHeapFree(many, blocks[1][i]) != (freed ? -1 : 0)) {
+            fprintf(stderr, "parallelWalk: myHeapFree of block %d went wrong\n", i);
+            return 1;
+        }
+    }
+    myHeapCoalesce(many);
+    if (myHeapStat(many, MYHEAP_STAT_LARGEST_FREE) != myHeapStat(many, MYHEAP_STAT_FREE_SIZE)
+            || myHeapStat(many, MYHEAP_STAT_USED_SIZE) != 0) {
+        fprintf(stderr, "parallelWalk: heap not merged into one block\n");
+        return 1;
+    }
+    myHeapDestroy(one);
+    myHeapDestroy(many);
+    printf("parallelWalk: ok\n");
+    return 0;
+}
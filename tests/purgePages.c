@@ -0,0 +1,116 @@
+/*
+ * With MYHEAP_OPT_PURGE the pages of a decayed free block go back to the
+ * OS and count as refaulted when they are handed out again, a free block
+ * at the end of the heap is cut off and can be grown back, and freeing a
+ * block twice must still fail after the block was merged into a free
+ * block in front of it that keeps a purge timestamp: the stamp must never
+ * be mistaken for the header the block had.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "myHeap.h"
+
+#define REGION (1 << 20)
+#define LARGE (256 * 1024)
+
+static myHeap* create(int engine, int coalesceMode) {
+    myOpt(MYHEAP_OPT_ENGINE, engine);
+    myOpt(MYHEAP_OPT_COALESCE, coalesceMode);
+    myOpt(MYHEAP_OPT_PURGE, MYHEAP_PURGE_DONTNEED);
+    myOpt(MYHEAP_OPT_PURGE_DECAY, 0);
+    myHeap *h = myHeapCreate(REGION);
+    if (h == NULL) {
+        fprintf(stderr, "purgePages: myHeapCreate failed\n");
+    }
+    return h;
+}
+
+static int purgeCounts(int engine) {
+    myHeap *h = create(engine, MYHEAP_COALESCE_DELAYED);
+    if (h == NULL) {
+        return 1;
+    }
+    void *front = myHeapAlloc(h, 32);
+    void *large = myHeapAlloc(h, LARGE);
+    void *guard = myHeapAlloc(h, 32);
+    if (front == NULL || large == NULL || guard == NULL) {
+        fprintf(stderr, "purgePages: myHeapAlloc failed\n");
+        return 1;
+    }
+    memset(large, 1, LARGE);
+    myHeapFree(h, large);
+    myHeapCoalesce(h);
+    if (myHeapStat(h, MYHEAP_STAT_PURGED_PAGES) == 0) {
+        fprintf(stderr, "purgePages: nothing purged (engine %d)\n", engine);
+        return 1;
+    }
+    if (myHeapStat(h, MYHEAP_STAT_HEAP_SIZE) >= REGION) {
+        fprintf(stderr, "purgePages: free tail not cut off (engine %d)\n", engine);
+        return 1;
+    }
+
+    // the same pages again, zeroed by the purge
+    large = myHeapAlloc(h, LARGE);
+    if (large == NULL || ((char*)large)[LARGE / 2] != 0) {
+        fprintf(stderr, "purgePages: purged block not handed out again (engine %d)\n", engine);
+        return 1;
+    }
+    if (myHeapStat(h, MYHEAP_STAT_REFAULTED_PAGES) == 0) {
+        fprintf(stderr, "purgePages: no refaulted pages counted (engine %d)\n", engine);
+        return 1;
+    }
+
+    // the tail that was cut off grows back
+    void *tail = myHeapAlloc(h, REGION / 2);
+    if (tail == NULL) {
+        fprintf(stderr, "purgePages: cut off tail not grown back (engine %d)\n", engine);
+        return 1;
+    }
+    myHeapDestroy(h);
+    return 0;
+}
+
+static int doubleFree(int engine, int coalesceMode) {
+    myHeap *h = create(engine, coalesceMode);
+    if (h == NULL) {
+        return 1;
+    }
+
+    // the stamp changes every millisecond, so it is both odd and even
+    // during some of the rounds
+    for (int round = 0; round < 32; round++) {
+        void *front = myHeapAlloc(h, 32);
+        void *large = myHeapAlloc(h, 3 * 4096);
+        void *guard = myHeapAlloc(h, 32);
+        if (front == NULL || large == NULL || guard == NULL) {
+            fprintf(stderr, "purgePages: myHeapAlloc failed\n");
+            return 1;
+        }
+        myHeapFree(h, front);
+        myHeapFree(h, large);
+        if (myHeapFree(h, large) != -1) {
+            fprintf(stderr, "purgePages: double free accepted (engine %d)\n", engine);
+            return 1;
+        }
+        myHeapFree(h, guard);
+        usleep(1000);
+    }
+    myHeapDestroy(h);
+    return 0;
+}
+
+int main() {
+    // a heap corrupted by the double free may loop instead of crashing
+    alarm(30);
+    int failed = 0;
+    for (int engine = MYHEAP_ENGINE_BINS; engine <= MYHEAP_ENGINE_TLSF; engine++) {
+        failed |= purgeCounts(engine);
+    }
+    failed |= doubleFree(MYHEAP_ENGINE_BINS, MYHEAP_COALESCE_IMMEDIATE);
+    failed |= doubleFree(MYHEAP_ENGINE_TLSF, MYHEAP_COALESCE_DELAYED);
+    if (!failed) {
+        printf("purgePages: ok\n");
+    }
+    return failed;
+}
@@ -0,0 +1,75 @@
+/*
+ * With MYHEAP_OPT_RECLAIM the reclaimer thread must merge and purge the
+ * blocks freed into the default heap without anyone calling coalesce(),
+ * and leave the merged blocks safe from a double free.
+ */
+#include <stdio.h>
+#include <time.h>
+#include "myHeap.h"
+#include "check.h"
+
+#define REGION (4 << 20)
+#define BLOCK 1000
+#define BLOCKS (REGION / 2 / BLOCK)
+#define INTERVAL 5
+// rounds to wait for before giving up
+#define WAIT_ROUNDS 400
+
+static void *blocks[BLOCKS];
+
+static int run(long coalesceMode) {
+    myOpt(MYHEAP_OPT_COALESCE, coalesceMode);
+    myOpt(MYHEAP_OPT_PURGE, MYHEAP_PURGE_DONTNEED);
+    myOpt(MYHEAP_OPT_PURGE_DECAY, 0);
+    myOpt(MYHEAP_OPT_RECLAIM, INTERVAL);
+    if (myInit(REGION) != 0) {
+        fprintf(stderr, "reclaimMerge: myInit failed\n");
+        return 1;
+    }
+    for (int i = 0; i < BLOCKS; i++) {
+        blocks[i] = myAlloc(BLOCK);
+        if (blocks[i] == NULL) {
+            fprintf(stderr, "reclaimMerge: myAlloc failed\n");
+            return 1;
+        }
+    }
+    for (int i = 0; i < BLOCKS; i++) {
+        myFree(blocks[i]);
+    }
+
+    struct timespec pause = { 0, INTERVAL * 1000000L };
+    int rounds = 0;
+    while (rounds < WAIT_ROUNDS && (myStat(MYHEAP_STAT_LARGEST_FREE) != myStat(MYHEAP_STAT_FREE_SIZE)
+            || myStat(MYHEAP_STAT_PURGED_PAGES) == 0)) {
+        nanosleep(&pause, NULL);
+        rounds++;
+    }
+    if (rounds == WAIT_ROUNDS) {
+        fprintf(stderr, "reclaimMerge: %ld of %ld free bytes merged, %ld pages purged (mode %ld)\n",
+                myStat(MYHEAP_STAT_LARGEST_FREE), myStat(MYHEAP_STAT_FREE_SIZE),
+                myStat(MYHEAP_STAT_PURGED_PAGES), coalesceMode);
+        return 1;
+    }
+
+    for (int i = 0; i < BLOCKS; i++) {
+        if (myFree(blocks[i]) != -1) {
+            fprintf(stderr, "reclaimMerge: merged block %d freed again (mode %ld)\n",
+                    i, coalesceMode);
+            return 1;
+        }
+    }
+    if (myAlloc(REGION - 4096) == NULL) {
+        fprintf(stderr, "reclaimMerge: the merged block is not found (mode %ld)\n", coalesceMode);
+        return 1;
+    }
+    return 0;
+}
+
+int main() {
+    int failed = runChild(run, MYHEAP_COALESCE_DELAYED);
+    failed |= runChild(run, MYHEAP_COALESCE_INCREMENTAL);
+    if (!failed) {
+        printf("reclaimMerge: ok\n");
+    }
+    return failed;
+}
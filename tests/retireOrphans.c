@@ -0,0 +1,36 @@
+/*
+ * Blocks retired by a thread that has exited must be freed by coalesce()
+ * even if the calling thread never used myEnter or myRetire itself.
+ */
+#include <stdio.h>
+#include <pthread.h>
+#include "myHeap.h"
+
+static void* retireSome(void *unused) {
+    (void)unused;
+    for (int i = 0; i < 100; i++) {
+        myRetire(myAlloc(40));
+    }
+    return NULL;
+}
+
+int main() {
+    if (myInit(1 << 20) != 0) {
+        fprintf(stderr, "retireOrphans: myInit failed\n");
+        return 1;
+    }
+    pthread_t worker;
+    pthread_create(&worker, NULL, retireSome, NULL);
+    pthread_join(worker, NULL);
+
+    for (int i = 0; i < 5; i++) {
+        coalesce();
+    }
+    long used = myStat(MYHEAP_STAT_USED_SIZE);
+    if (used != 0) {
+        fprintf(stderr, "retireOrphans: %ld bytes still used\n", used);
+        return 1;
+    }
+    printf("retireOrphans: ok\n");
+    return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * With MYHEAP_OPT_RETRY a call that finds no free block large enough must
+ * merge free blocks and retry, and MYHEAP_STAT_LAST_RETRY must tell the
+ * calling thread whether that call merged and whether the retry found a
+ * block.
+ */
+#include <stdio.h>
+#include "myHeap.h"
+
+// few enough blocks to all wait in the queue of incremental coalescing
+#define REGION (16 * 1024)
+#define BLOCK 64
+#define BLOCKS (REGION / (BLOCK + 16))
+
+static void *blocks[BLOCKS];
+
+static int run(int coalesceMode) {
+    myOpt(MYHEAP_OPT_ENGINE, MYHEAP_ENGINE_BINS);
+    myOpt(MYHEAP_OPT_COALESCE, coalesceMode);
+    myOpt(MYHEAP_OPT_RETRY, 1);
+    myHeap *h = myHeapCreate(REGION);
+    if (h == NULL) {
+        fprintf(stderr, "retryHits: myHeapCreate failed\n");
+        return 1;
+    }
+
+    // fill the heap with small blocks and free them unmerged
+    int count = 0;
+    while (count < BLOCKS && (blocks[count] = myHeapAlloc(h, BLOCK)) != NULL) {
+        count++;
+    }
+    for (int i = 0; i < count; i++) {
+        myHeapFree(h, blocks[i]);
+    }
+
+    int failed = 0;
+    void *small = myHeapAlloc(h, BLOCK);
+    if (small == NULL || myHeapStat(h, MYHEAP_STAT_LAST_RETRY) != MYHEAP_RETRY_NONE) {
+        fprintf(stderr, "retryHits: a fitting block was not handed out directly (mode %d)\n",
+                coalesceMode);
+        failed = 1;
+    }
+    myHeapFree(h, small);
+
+    // only merging the freed blocks makes room for this one
+    void *large = myHeapAlloc(h, REGION / 4);
+    if (large == NULL || myHeapStat(h, MYHEAP_STAT_LAST_RETRY) != MYHEAP_RETRY_HIT) {
+        fprintf(stderr, "retryHits: the retry did not find a merged block (mode %d)\n",
+                coalesceMode);
+        failed = 1;
+    }
+
+    // the merged block stays in the way of one this large
+    if (myHeapAlloc(h, REGION - REGION / 8) != NULL
+            || myHeapStat(h, MYHEAP_STAT_LAST_RETRY) != MYHEAP_RETRY_MISS) {
+        fprintf(stderr, "retryHits: an oversized call was not reported as missed (mode %d)\n",
+                coalesceMode);
+        failed = 1;
+    }
+    if (myHeapStat(h, MYHEAP_STAT_RETRIES) != 2 || myHeapStat(h, MYHEAP_STAT_RETRY_HITS) != 1) {
+        fprintf(stderr, "retryHits: %ld retries, %ld hits (mode %d)\n",
+                myHeapStat(h, MYHEAP_STAT_RETRIES), myHeapStat(h, MYHEAP_STAT_RETRY_HITS),
+                coalesceMode);
+        failed = 1;
+    }
+
+    // the merged block is an ordinary block
+    if (myHeapFree(h, large) != 0 || myHeapFree(h, large) == 0) {
+        fprintf(stderr, "retryHits: freeing the merged block went wrong (mode %d)\n",
+                coalesceMode);
+        failed = 1;
+    }
+    myHeapDestroy(h);
+    return failed;
+}
+
+int main() {
+    int failed = run(MYHEAP_COALESCE_DELAYED);
+    failed |= run(MYHEAP_COALESCE_INCREMENTAL);
+    if (!failed) {
+        printf("retryHits: ok\n");
+    }
+    return failed;
+}
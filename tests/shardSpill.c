@@ -0,0 +1,81 @@
+/*
+ * With MYHEAP_OPT_SHARDS myAlloc must move on to the other shards once
+ * one is full, fail only for requests larger than a shard, and coalesce()
+ * must merge every shard back into one free block.  The per-thread cache
+ * asked for is left off, so every block freed goes straight back.
+ */
+#include <stdio.h>
+#include <pthread.h>
+#include "myHeap.h"
+
+#define SHARDS 4
+#define SHARD (1 << 20)
+#define THREADS 4
+#define BLOCK 1000
+// three quarters of all shards, more than a shard holds
+#define BLOCKS (3 * SHARDS * SHARD / 4 / BLOCK / THREADS)
+
+static void *blocks[THREADS][BLOCKS];
+
+static void* allocSome(void *arg) {
+    void **mine = arg;
+    for (int i = 0; i < BLOCKS; i++) {
+        mine[i] = myAlloc(BLOCK);
+    }
+    return NULL;
+}
+
+int main() {
+    myOpt(MYHEAP_OPT_SHARDS, SHARDS);
+    myOpt(MYHEAP_OPT_TCACHE, 32);
+    if (myInit(SHARDS * SHARD) != 0) {
+        fprintf(stderr, "shardSpill: myInit failed\n");
+        return 1;
+    }
+    if (myStat(MYHEAP_STAT_SHARDS) != SHARDS) {
+        fprintf(stderr, "shardSpill: %ld shards\n", myStat(MYHEAP_STAT_SHARDS));
+        return 1;
+    }
+
+    pthread_t workers[THREADS];
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&workers[t], NULL, allocSome, blocks[t]);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(workers[t], NULL);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        for (int i = 0; i < BLOCKS; i++) {
+            if (blocks[t][i] == NULL) {
+                fprintf(stderr, "shardSpill: myAlloc failed with room in other shards\n");
+                return 1;
+            }
+        }
+    }
+    if (myAlloc(SHARD + 8) != NULL) {
+        fprintf(stderr, "shardSpill: block larger than a shard handed out\n");
+        return 1;
+    }
+
+    for (int t = 0; t < THREADS; t++) {
+        for (int i = 0; i < BLOCKS; i++) {
+            if (myFree(blocks[t][i]) != 0 || myFree(blocks[t][i]) != -1) {
+                fprintf(stderr, "shardSpill: myFree failed or accepted a double free\n");
+                return 1;
+            }
+        }
+    }
+    coalesce();
+
+    // every shard is one free block again
+    void *whole[SHARDS];
+    for (int i = 0; i < SHARDS; i++) {
+        whole[i] = myAlloc(SHARD - 4096);
+        if (whole[i] == NULL) {
+            fprintf(stderr, "shardSpill: shard %d not merged\n", i);
+            return 1;
+        }
+    }
+    printf("shardSpill: ok\n");
+    return 0;
+}
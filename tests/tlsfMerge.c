@@ -0,0 +1,55 @@
+/*
+ * The TLSF engine merges blocks as they are freed, so freeing everything in
+ * any order must leave one free block without a coalesce() call, and a
+ * block must not be freed twice.
+ */
+#include <stdio.h>
+#include "myHeap.h"
+
+#define REGION (256 * 1024)
+#define BLOCKS 1000
+
+static void *blocks[BLOCKS];
+
+int main() {
+    myOpt(MYHEAP_OPT_ENGINE, MYHEAP_ENGINE_TLSF);
+    myHeap *h = myHeapCreate(REGION);
+    if (h == NULL) {
+        fprintf(stderr, "tlsfMerge: myHeapCreate failed\n");
+        return 1;
+    }
+
+    // sizes from a few bytes to a few hundred, spread over the classes
+    for (int i = 0; i < BLOCKS; i++) {
+        blocks[i] = myHeapAlloc(h, 8 + (i * 37) % 200);
+        if (blocks[i] == NULL) {
+            fprintf(stderr, "tlsfMerge: myHeapAlloc failed\n");
+            return 1;
+        }
+    }
+
+    // every other block first, then the rest, so each free has neighbours to merge
+    for (int start = 0; start < 2; start++) {
+        for (int i = start; i < BLOCKS; i += 2) {
+            if (myHeapFree(h, blocks[i]) != 0 || myHeapFree(h, blocks[i]) != -1) {
+                fprintf(stderr, "tlsfMerge: myHeapFree failed or accepted a double free\n");
+                return 1;
+            }
+        }
+    }
+
+    long freeSize = myHeapStat(h, MYHEAP_STAT_FREE_SIZE);
+    long largest = myHeapStat(h, MYHEAP_STAT_LARGEST_FREE);
+    if (largest != freeSize) {
+        fprintf(stderr, "tlsfMerge: %ld of %ld free bytes in the largest block\n",
+                largest, freeSize);
+        return 1;
+    }
+    if (myHeapAlloc(h, REGION - 4096) == NULL) {
+        fprintf(stderr, "tlsfMerge: the merged block is not found\n");
+        return 1;
+    }
+    myHeapDestroy(h);
+    printf("tlsfMerge: ok\n");
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * The tree engine must hand out the smallest free block that fits, the
+ * one at the lowest address among blocks of that size, reject freeing a
+ * block twice and merge everything back with coalesce().
+ */
+#include <stdio.h>
+#include "myHeap.h"
+
+#define REGION (64 * 1024)
+#define SIZES 6
+
+// free blocks of these sizes end up between allocated ones
+static const int sizes[SIZES] = { 400, 96, 200, 96, 296, 1000 };
+
+int main() {
+    myOpt(MYHEAP_OPT_ENGINE, MYHEAP_ENGINE_TREE);
+    myHeap *h = myHeapCreate(REGION);
+    if (h == NULL) {
+        fprintf(stderr, "treeBestFit: myHeapCreate failed\n");
+        return 1;
+    }
+
+    void *holes[SIZES];
+    void *walls[SIZES];
+    for (int i = 0; i < SIZES; i++) {
+        holes[i] = myHeapAlloc(h, sizes[i]);
+        walls[i] = myHeapAlloc(h, 8);
+        if (holes[i] == NULL || walls[i] == NULL) {
+            fprintf(stderr, "treeBestFit: myHeapAlloc failed\n");
+            return 1;
+        }
+    }
+    for (int i = 0; i < SIZES; i++) {
+        if (myHeapFree(h, holes[i]) != 0 || myHeapFree(h, holes[i]) != -1) {
+            fprintf(stderr, "treeBestFit: myHeapFree failed or accepted a double free\n");
+            return 1;
+        }
+    }
+
+    // the lower of the two equal blocks, then the next larger one
+    if (myHeapAlloc(h, 96) != holes[1]) {
+        fprintf(stderr, "treeBestFit: equal blocks not taken by address\n");
+        return 1;
+    }
+    if (myHeapAlloc(h, 150) != holes[2]) {
+        fprintf(stderr, "treeBestFit: not the smallest block that fits\n");
+        return 1;
+    }
+    if (myHeapAlloc(h, 96) != holes[3]) {
+        fprintf(stderr, "treeBestFit: second equal block not taken\n");
+        return 1;
+    }
+
+    myHeapFree(h, holes[1]);
+    myHeapFree(h, holes[2]);
+    myHeapFree(h, holes[3]);
+    for (int i = 0; i < SIZES; i++) {
+        myHeapFree(h, walls[i]);
+    }
+    myHeapCoalesce(h);
+    if (myHeapAlloc(h, REGION - 4096) == NULL) {
+        fprintf(stderr, "treeBestFit: heap not merged into one block\n");
+        return 1;
+    }
+    myHeapDestroy(h);
+    printf("treeBestFit: ok\n");
+    return 0;
+}